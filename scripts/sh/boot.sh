@@ -57,8 +57,22 @@ start_log () {
 }
 
 source_start_scripts () {
-  if test -d /etc/runit/sh ; then
-    for i in /etc/runit/sh/S?* ; do
+  local d=/etc/runit/sh i
+
+  test -d "$d" || return 0
+
+  if test -n "$RC_JOBS" && command -v rcorder > /dev/null 2>&1 ; then
+    ## opt-in: let rcorder run the scripts in dependency order,
+    ## independent ones in parallel in their own shells
+    ## (and reuse their parsed headers from $RC_CACHE if set)
+    set --
+    for i in "$d"/S?* ; do
+      test -f "$i" -a -r "$i" -a -s "$i" && set -- "$@" "$i"
+    done
+    test $# -gt 0 || return 0
+    rcorder ${RC_CACHE:+-C "$RC_CACHE"} -j "$RC_JOBS" -x start "$@"
+  else
+    for i in "$d"/S?* ; do
       test -f "$i" -a -r "$i" -a -s "$i" && . "$i" start
     done
   fi
@@ -108,7 +108,7 @@ static char sccsid[] = "@(#)hash.c	8.1 (Berkeley) 6/6/93";
  * defined:
  */
 
-static void RebuildTable(Hash_Table *);
+static void RebuildTable(Hash_Table *, int);
 
 /*
  * The following defines the ratio of # entries to # buckets
@@ -117,6 +117,13 @@ static void RebuildTable(Hash_Table *);
 
 #define rebuildLimit 8
 
+/*
+ * The most buckets Hash_ReserveTable asks for, so that doubling
+ * the size up to it cannot overflow an int.
+ */
+
+#define maxSize (1 << 30)
+
 /*
  *---------------------------------------------------------
  *
@@ -203,6 +210,38 @@ Hash_DeleteTable(Hash_Table *t)
 	t->bucketPtr = NULL;
 }
 
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_ReserveTable --
+ *
+ *	Makes room for numEntries entries in all, one per bucket,
+ *	so a table that is about to be filled with that many keys
+ *	is not rebuilt over and over while it grows.  The table
+ *	never shrinks.
+ *
+ * Results:
+ *	None.
+ *
+ * Side Effects:
+ *	The table may be rebuilt with more buckets.
+ *
+ *---------------------------------------------------------
+ */
+
+void
+Hash_ReserveTable(Hash_Table *t, int numEntries)
+{
+	int i;
+
+	if (numEntries > maxSize)
+		numEntries = maxSize;
+	for (i = t->size; i < numEntries; i <<= 1)
+		continue;
+	if (i > t->size)
+		RebuildTable(t, i);
+}
+
 /*
  *---------------------------------------------------------
  *
@@ -296,7 +335,7 @@ Hash_CreateEntry(Hash_Table *t, char *key, int *newPtr)
 	 * bucket chain).
 	 */
 	if (t->numEntries >= rebuildLimit * t->size)
-		RebuildTable(t);
+		RebuildTable(t, t->size << 1);
 	e = (Hash_Entry *) emalloc(sizeof(*e) + keylen);
 	hp = &t->bucketPtr[h & t->mask];
 	e->next = *hp;
@@ -431,7 +470,7 @@ Hash_EnumNext(Hash_Search *searchPtr)
  *
  * RebuildTable --
  *	This local routine makes a new hash table that
- *	is larger than the old one.
+ *	is larger than the old one, with newSize buckets.
  *
  * Results:
  * 	None.
@@ -444,7 +483,7 @@ Hash_EnumNext(Hash_Search *searchPtr)
  */
 
 static void
-RebuildTable(Hash_Table *t)
+RebuildTable(Hash_Table *t, int newSize)
 {
 	Hash_Entry *e, *next, **hp, **xp;
 	int i, mask;
@@ -453,8 +492,8 @@ RebuildTable(Hash_Table *t)
 
 	next = NULL;
 	oldhp = t->bucketPtr;
-	oldsize = i = t->size;
-	i <<= 1;
+	oldsize = t->size;
+	i = newSize;
 	t->size = i;
 	t->mask = mask = i - 1;
 	t->bucketPtr = hp = (struct Hash_Entry **) emalloc(sizeof(*hp) * i);
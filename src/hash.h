@@ -86,6 +86,34 @@
  * The following defines one entry in the hash table.
  */
 
+#ifdef HASH_OPEN_ADDRESSING
+
+/*
+ * With HASH_OPEN_ADDRESSING the table is the Robin Hood hash of
+ * hashoa.c: the entries hang off a flat array of slots instead of
+ * bucket chains, and the hashes of the slots are kept in an array of
+ * their own, so a probe only dereferences an entry whose hash matches.
+ */
+
+typedef struct Hash_Entry {
+	void		*clientData;	/* Arbitrary piece of data associated
+					 * with key. */
+	unsigned	namehash;	/* hash value of key, never 0 */
+	unsigned	namelen;	/* strlen of key */
+	char		name[1];	/* key string */
+} Hash_Entry;
+
+typedef struct Hash_Table {
+	unsigned	*hashPtr;	/* Hash of the entry in each slot,
+					 * 0 if the slot is empty. */
+	struct	Hash_Entry **entryPtr;	/* Entry in each slot. */
+	int 	size;		/* Number of slots, a power of two. */
+	int 	numEntries;	/* Number of entries in the table. */
+	int 	mask;		/* Used to select bits for hashing. */
+} Hash_Table;
+
+#else
+
 typedef struct Hash_Entry {
 	struct	Hash_Entry *next;	/* Used to link together all the
 					 * entries associated with the same
@@ -105,6 +133,8 @@ typedef struct Hash_Table {
 	int 	mask;		/* Used to select bits for hashing. */
 } Hash_Table;
 
+#endif /* HASH_OPEN_ADDRESSING */
+
 /*
  * The following structure is used by the searching routines
  * to record where we are in the search.
@@ -118,6 +148,54 @@ typedef struct Hash_Search {
 					 * bucket. */
 } Hash_Search;
 
+/*
+ * A frozen table is a read-only copy of a Hash_Table, made by
+ * Hash_Freeze() once the table is complete.  It is a perfect hash
+ * (hash and displace) over the keys: each key has a slot of its own,
+ * found with one hash, one bucket displacement and one key compare,
+ * so lookups never collide and never allocate.  There are only about
+ * 1% more slots than keys.  Slots are numbered 0 .. numSlots - 1 and
+ * hold the clientData of the entries.  Hash_FrozenSave() writes the
+ * table (without the client data) to a file, for instance a cache,
+ * and Hash_FrozenLoad() reads it back in one go.
+ */
+
+typedef struct Hash_Frozen {
+	unsigned	numEntries;	/* Number of keys. */
+	unsigned	numSlots;	/* Number of slots. */
+	unsigned	numBuckets;	/* Number of displacement buckets. */
+	unsigned	namesLen;	/* Bytes of key strings. */
+	unsigned	*dispPtr;	/* Displacement of each bucket. */
+	unsigned	*hashPtr;	/* Check hash of each slot. */
+	unsigned	*keyPtr;	/* Offset of the key of each slot in
+					 * names, ~0 if the slot is free. */
+	char		*names;		/* The keys, NUL terminated. */
+	void		**valuePtr;	/* Client data of each slot. */
+} Hash_Frozen;
+
+/*
+ * A shared table can be looked up and filled by several threads at
+ * the same time, without locks: a split-ordered list (Shalev and
+ * Shavit).  All entries are on one linked list sorted by their
+ * bit-reversed hash, and bucket i points to a dummy node on it where
+ * the entries with hash i mod size begin.  Doubling the size only
+ * splits each bucket in two on the same list, so nothing is moved and
+ * nobody waits.  New buckets are set up as they are first used.  The
+ * bucket pointers are kept in segments of growing size, segment s
+ * holding buckets 2^(s-1) .. 2^s - 1.  Entries are never removed
+ * before the table is deleted, which keeps all of this simple.
+ */
+
+#define	HASH_SHARED_SEGMENTS	32
+
+typedef struct Hash_Shared {
+	struct Hash_SharedNode	**segPtr[HASH_SHARED_SEGMENTS];
+					/* Bucket segments, allocated when
+					 * first used. */
+	unsigned	size;		/* Buckets in use, a power of two. */
+	unsigned	numEntries;	/* Number of entries in the table. */
+} Hash_Shared;
+
 /*
  * Macros.
  */
@@ -150,6 +228,15 @@ typedef struct Hash_Search {
 
 #define	Hash_Size(n)	(((n) + sizeof (int) - 1) / sizeof (int))
 
+/*
+ * void *Hash_FrozenValue(f, i), Hash_FrozenSetValue(f, i, val) and
+ * char *Hash_FrozenKey(f, i) do the same for slot i of a frozen table.
+ */
+
+#define Hash_FrozenValue(f, i) ((f)->valuePtr[i])
+#define Hash_FrozenSetValue(f, i, val) ((f)->valuePtr[i] = (void *) (val))
+#define Hash_FrozenKey(f, i) ((f)->names + (f)->keyPtr[i])
+
 #ifdef __linux__
 static void * emalloc ( const size_t size )
 {
@@ -164,13 +251,52 @@ static void * emalloc ( const size_t size )
 }
 #endif
 
+/*
+ * unsigned long long Hash_Mix(key, lenPtr)
+ *	The 64 bit hash of a key for the open addressing, frozen and
+ *	shared tables, 8 bytes at a time with a multiply and xor-shift
+ *	mixer.  The length of the key is left in *lenPtr.
+ */
+
+static __inline__ unsigned long long
+Hash_Mix(const char *key, size_t *lenPtr)
+{
+	const size_t len = strlen(key);
+	unsigned long long h = 0x9e3779b97f4a7c15ULL ^ len, w;
+	size_t n;
+
+	for (n = len; n >= 8; n -= 8, key += 8) {
+		memcpy(&w, key, 8);
+		h = (h ^ w) * 0xbf58476d1ce4e5b9ULL;
+		h ^= h >> 31;
+	}
+	w = 0;
+	memcpy(&w, key, n);
+	h = (h ^ w) * 0x94d049bb133111ebULL;
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 32;
+	*lenPtr = len;
+	return (h);
+}
+
 void Hash_InitTable(Hash_Table *, int);
 void Hash_DeleteTable(Hash_Table *);
+void Hash_ReserveTable(Hash_Table *, int);
 Hash_Entry *Hash_FindEntry(Hash_Table *, char *);
 Hash_Entry *Hash_CreateEntry(Hash_Table *, char *, int *);
 void Hash_DeleteEntry(Hash_Table *, Hash_Entry *);
 Hash_Entry *Hash_EnumFirst(Hash_Table *, Hash_Search *);
 Hash_Entry *Hash_EnumNext(Hash_Search *);
+int Hash_Freeze(Hash_Table *, Hash_Frozen *);
+int Hash_FrozenFind(const Hash_Frozen *, const char *);
+int Hash_FrozenSave(const Hash_Frozen *, FILE *);
+int Hash_FrozenLoad(Hash_Frozen *, FILE *);
+void Hash_FrozenFree(Hash_Frozen *);
+void Hash_InitShared(Hash_Shared *, int);
+void Hash_DeleteShared(Hash_Shared *);
+Hash_Entry *Hash_SharedFind(Hash_Shared *, const char *);
+Hash_Entry *Hash_SharedCreate(Hash_Shared *, const char *, int *);
 
 #endif /* _HASH */
 
@@ -0,0 +1,447 @@
+/*
+ * benchmark the Hash_* functions of hash.h, on whichever backend this
+ * is built with (hash.c, or hashoa.c with -DHASH_OPEN_ADDRESSING).
+ *
+ * usage: hashbench [ size ... ]
+ *
+ * for each key set and size it reports the nanoseconds per insert, hit
+ * lookup, miss lookup, delete and per entry of a full enumeration, and
+ * the bytes the table takes per entry (keys included, 0 without
+ * glibc).  the table is then frozen (hashfrozen.c), and the nanoseconds
+ * per key of Hash_Freeze and of hit and miss lookups in the frozen
+ * table follow.
+ * last come the nanoseconds per insert, hit and miss of a shared table
+ * (hashshared.c) with THREADS threads doing each at the same time, the
+ * slowest thread counts.  every thread creates every key, in its own
+ * order, and all must get the same entries.  the key sets
+ * are service names (short words with a few digits), provision names
+ * as rcgen makes them (p0, p1, ...) and paths with a long common
+ * prefix.  lookups and deletes go in a fixed random order.  the keys
+ * are the same on every run, small sizes are repeated to get about
+ * OPS operations timed.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "hash.h"
+
+#define OPS		( 1UL << 20 )
+#define THREADS		4
+
+static const char * const words [ ] = {
+  "net", "ssh", "cron", "sys", "log", "udev", "dbus", "getty", "mount",
+  "swap", "fsck", "ntp", "dhcp", "rpc", "nfs", "mdev", "klog", "acpi",
+  "cups", "bluetooth", "console", "hostname", "sysctl", "local", "random",
+} ;
+
+#define NWORDS	( sizeof ( words ) / sizeof ( words [ 0 ] ) )
+
+static const unsigned long int default_sizes [ ] = {
+  16, 256, 4096, 65536, 1048576,
+} ;
+
+static unsigned long int seed = 1 ;
+
+/* small LCG, so the keys do not depend on the libc's rand() */
+static unsigned long int rnd ( const unsigned long int n )
+{
+  seed = seed * 6364136223846793005UL + 1442695040888963407UL ;
+
+  return n ? ( seed >> 33 ) % n : 0 ;
+}
+
+static double now_ns ( void )
+{
+  struct timespec ts ;
+
+  (void) clock_gettime ( CLOCK_MONOTONIC, & ts ) ;
+
+  return ts . tv_sec * 1e9 + ts . tv_nsec ;
+}
+
+/* bytes malloc() hands out right now, 0 without glibc's mallinfo() */
+static size_t heap_used ( void )
+{
+#if defined (__GLIBC__) && ( 2 < __GLIBC__ || 33 <= __GLIBC_MINOR__ )
+  return mallinfo2 () . uordblks ;
+#elif defined (__GLIBC__)
+  return (unsigned) mallinfo () . uordblks ;
+#else
+  return 0 ;
+#endif
+}
+
+/*
+ * key i of a set.  i >= the size gives keys of the same shape that
+ * are not in the table, for the misses.
+ */
+static void make_key ( char * buf, size_t len, const int set,
+  const unsigned long int i )
+{
+  switch ( set ) {
+    case 0 :
+      (void) snprintf ( buf, len, "%s%s%lu", words [ i % NWORDS ],
+        words [ ( i / NWORDS ) % NWORDS ], i / ( NWORDS * NWORDS ) ) ;
+      break ;
+    case 1 :
+      (void) snprintf ( buf, len, "p%lu", i ) ;
+      break ;
+    default :
+      (void) snprintf ( buf, len, "/etc/rc.d/init.d/services/available/"
+        "%08lu/run", i ) ;
+      break ;
+  }
+}
+
+static const char * const set_names [ ] = { "service", "provision", "path" } ;
+
+/* n keys of a set, from key first on */
+static char ** make_keys ( const int set, const unsigned long int first,
+  const unsigned long int n )
+{
+  char ** keys = emalloc ( n * sizeof ( * keys ) ) ;
+  char buf [ 128 ] = { 0 } ;
+  unsigned long int i ;
+
+  for ( i = 0 ; i < n ; ++ i ) {
+    make_key ( buf, sizeof ( buf ), set, first + i ) ;
+    keys [ i ] = emalloc ( strlen ( buf ) + 1 ) ;
+    strcpy ( keys [ i ], buf ) ;
+  }
+
+  return keys ;
+}
+
+static void free_keys ( char ** keys, const unsigned long int n )
+{
+  unsigned long int i ;
+
+  for ( i = 0 ; i < n ; ++ i ) { free ( keys [ i ] ) ; }
+  free ( keys ) ;
+}
+
+/* one of the threads working on a shared table */
+typedef struct worker {
+  Hash_Shared		* t ;
+  char			** keys, ** miss ;
+  unsigned long int	* perm, n, reps, found ;
+  Hash_Entry		** got ;	/* what it got for each key */
+  int			id ;
+  double		ins, hit, mis ;
+} worker ;
+
+static pthread_barrier_t barrier ;
+
+static void * shared_worker ( void * arg )
+{
+  worker * const w = arg ;
+  const unsigned long int off = w -> id * ( w -> n / THREADS ) ;
+  unsigned long int i, r ;
+  double t0 ;
+  int new = 0 ;
+
+  for ( r = 0 ; r < w -> reps ; ++ r ) {
+    (void) pthread_barrier_wait ( & barrier ) ;
+    t0 = now_ns () ;
+    for ( i = 0 ; i < w -> n ; ++ i ) {
+      const unsigned long int k = w -> perm [ ( i + off ) % w -> n ] ;
+      w -> got [ k ] = Hash_SharedCreate ( w -> t, w -> keys [ k ], & new ) ;
+    }
+    w -> ins += now_ns () - t0 ;
+    (void) pthread_barrier_wait ( & barrier ) ;
+
+    /* the next round starts with an empty table, the last one is kept */
+    if ( 0 == w -> id && r + 1 < w -> reps ) {
+      Hash_DeleteShared ( w -> t ) ;
+      Hash_InitShared ( w -> t, 0 ) ;
+    }
+  }
+
+  (void) pthread_barrier_wait ( & barrier ) ;
+  t0 = now_ns () ;
+  for ( r = 0 ; r < w -> reps ; ++ r ) {
+    for ( i = 0 ; i < w -> n ; ++ i ) {
+      w -> found += NULL != Hash_SharedFind ( w -> t,
+        w -> keys [ w -> perm [ ( i + off ) % w -> n ] ] ) ;
+    }
+  }
+  w -> hit = now_ns () - t0 ;
+
+  (void) pthread_barrier_wait ( & barrier ) ;
+  t0 = now_ns () ;
+  for ( r = 0 ; r < w -> reps ; ++ r ) {
+    for ( i = 0 ; i < w -> n ; ++ i ) {
+      w -> found += NULL != Hash_SharedFind ( w -> t,
+        w -> miss [ w -> perm [ ( i + off ) % w -> n ] ] ) ;
+    }
+  }
+  w -> mis = now_ns () - t0 ;
+
+  return NULL ;
+}
+
+/* the shared table columns: slowest thread's ns per insert, hit, miss */
+static void bench_shared ( const int set, char ** keys, char ** miss,
+  unsigned long int * perm, const unsigned long int n,
+  const unsigned long int reps, double * res )
+{
+  Hash_Shared t ;
+  pthread_t tid [ THREADS ] ;
+  worker w [ THREADS ] ;
+  unsigned long int i ;
+  int j ;
+
+  Hash_InitShared ( & t, 0 ) ;
+  (void) pthread_barrier_init ( & barrier, NULL, THREADS ) ;
+
+  for ( j = 0 ; j < THREADS ; ++ j ) {
+    (void) memset ( & w [ j ], 0, sizeof ( w [ j ] ) ) ;
+    w [ j ] . t = & t ;
+    w [ j ] . keys = keys ;
+    w [ j ] . miss = miss ;
+    w [ j ] . perm = perm ;
+    w [ j ] . n = n ;
+    w [ j ] . reps = reps ;
+    w [ j ] . got = emalloc ( n * sizeof ( * w [ j ] . got ) ) ;
+    w [ j ] . id = j ;
+    if ( pthread_create ( & tid [ j ], NULL, shared_worker, & w [ j ] ) ) {
+      perror ( "hashbench: pthread_create" ) ;
+      exit ( 1 ) ;
+    }
+  }
+
+  res [ 0 ] = res [ 1 ] = res [ 2 ] = 0 ;
+  for ( j = 0 ; j < THREADS ; ++ j ) {
+    (void) pthread_join ( tid [ j ], NULL ) ;
+    if ( res [ 0 ] < w [ j ] . ins ) { res [ 0 ] = w [ j ] . ins ; }
+    if ( res [ 1 ] < w [ j ] . hit ) { res [ 1 ] = w [ j ] . hit ; }
+    if ( res [ 2 ] < w [ j ] . mis ) { res [ 2 ] = w [ j ] . mis ; }
+  }
+  for ( j = 0 ; j < 3 ; ++ j ) { res [ j ] /= reps * n ; }
+
+  /* one entry per key, the one every thread got, and no miss */
+  for ( j = 0 ; j < THREADS ; ++ j ) {
+    for ( i = 0 ; i < n ; ++ i ) {
+      if ( w [ j ] . got [ i ] != w [ 0 ] . got [ i ]
+        || w [ j ] . got [ i ] != Hash_SharedFind ( & t, keys [ i ] )
+        || strcmp ( Hash_GetKey ( w [ j ] . got [ i ] ), keys [ i ] ) ) {
+        fprintf ( stderr, "hashbench: %s %lu: shared key %s differs\n",
+          set_names [ set ], n, keys [ i ] ) ;
+        exit ( 1 ) ;
+      }
+    }
+    if ( w [ j ] . found != reps * n ) {
+      fprintf ( stderr, "hashbench: %s %lu: %lu shared entries found\n",
+        set_names [ set ], n, w [ j ] . found ) ;
+      exit ( 1 ) ;
+    }
+  }
+  for ( j = 0 ; j < THREADS ; ++ j ) { free ( w [ j ] . got ) ; }
+  if ( t . numEntries != n ) {
+    fprintf ( stderr, "hashbench: %s %lu: %u shared entries\n",
+      set_names [ set ], n, t . numEntries ) ;
+    exit ( 1 ) ;
+  }
+
+  (void) pthread_barrier_destroy ( & barrier ) ;
+  Hash_DeleteShared ( & t ) ;
+}
+
+static void fill ( Hash_Table * t, char ** keys, Hash_Entry ** ents,
+  const unsigned long int n )
+{
+  unsigned long int i ;
+  int new = 0 ;
+
+  Hash_InitTable ( t, 0 ) ;
+  for ( i = 0 ; i < n ; ++ i ) {
+    ents [ i ] = Hash_CreateEntry ( t, keys [ i ], & new ) ;
+  }
+}
+
+static void bench ( const int set, const unsigned long int n )
+{
+  Hash_Table t ;
+  Hash_Search search ;
+  Hash_Entry * e ;
+  char ** keys = make_keys ( set, 0, n ) ;
+  char ** miss = make_keys ( set, n, n ) ;
+  Hash_Entry ** ents = emalloc ( n * sizeof ( * ents ) ) ;
+  unsigned long int * perm = emalloc ( n * sizeof ( * perm ) ) ;
+  const unsigned long int reps = OPS / n ? OPS / n : 1 ;
+  unsigned long int i, j, r, x, found = 0 ;
+  double t0, ins = 0, hit = 0, mis = 0, del = 0, en = 0 ;
+  double frz = 0, fhit = 0, fmis = 0, sh [ 3 ] ;
+  Hash_Frozen f ;
+  FILE * fp = NULL ;
+  int slot ;
+  size_t before = 0, bytes = 0 ;
+
+  /* a fixed random order for the lookups and deletes */
+  for ( i = 0 ; i < n ; ++ i ) { perm [ i ] = i ; }
+  for ( i = n - 1 ; 0 < i ; -- i ) {
+    j = rnd ( i + 1 ) ;
+    x = perm [ i ] ; perm [ i ] = perm [ j ] ; perm [ j ] = x ;
+  }
+
+  /* mallinfo() walks the free lists, it is not timed and only run once */
+  before = heap_used () ;
+  fill ( & t, keys, ents, n ) ;
+  bytes = heap_used () - before ;
+  Hash_DeleteTable ( & t ) ;
+
+  for ( r = 0 ; r < reps ; ++ r ) {
+    t0 = now_ns () ;
+    fill ( & t, keys, ents, n ) ;
+    ins += now_ns () - t0 ;
+    Hash_DeleteTable ( & t ) ;
+  }
+
+  fill ( & t, keys, ents, n ) ;
+
+  t0 = now_ns () ;
+  for ( r = 0 ; r < reps ; ++ r ) {
+    for ( i = 0 ; i < n ; ++ i ) {
+      found += NULL != Hash_FindEntry ( & t, keys [ perm [ i ] ] ) ;
+    }
+  }
+  hit = now_ns () - t0 ;
+
+  t0 = now_ns () ;
+  for ( r = 0 ; r < reps ; ++ r ) {
+    for ( i = 0 ; i < n ; ++ i ) {
+      found += NULL != Hash_FindEntry ( & t, miss [ perm [ i ] ] ) ;
+    }
+  }
+  mis = now_ns () - t0 ;
+
+  t0 = now_ns () ;
+  for ( r = 0 ; r < reps ; ++ r ) {
+    for ( e = Hash_EnumFirst ( & t, & search ) ; e ;
+      e = Hash_EnumNext ( & search ) )
+    { ++ found ; }
+  }
+  en = now_ns () - t0 ;
+
+  for ( r = 0 ; r < reps ; ++ r ) {
+    t0 = now_ns () ;
+    if ( 0 > Hash_Freeze ( & t, & f ) ) {
+      fprintf ( stderr, "hashbench: %s %lu: no perfect hash\n",
+        set_names [ set ], n ) ;
+      exit ( 1 ) ;
+    }
+    frz += now_ns () - t0 ;
+    if ( r + 1 < reps ) { Hash_FrozenFree ( & f ) ; }
+  }
+
+  t0 = now_ns () ;
+  for ( r = 0 ; r < reps ; ++ r ) {
+    for ( i = 0 ; i < n ; ++ i ) {
+      slot = Hash_FrozenFind ( & f, keys [ perm [ i ] ] ) ;
+      found += 0 <= slot ;
+    }
+  }
+  fhit = now_ns () - t0 ;
+
+  t0 = now_ns () ;
+  for ( r = 0 ; r < reps ; ++ r ) {
+    for ( i = 0 ; i < n ; ++ i ) {
+      found += 0 <= Hash_FrozenFind ( & f, miss [ perm [ i ] ] ) ;
+    }
+  }
+  fmis = now_ns () - t0 ;
+
+  /*
+   * the frozen table, once saved and loaded again, has the keys of the
+   * table, each in its own slot
+   */
+  if ( NULL == ( fp = tmpfile () ) || 0 > Hash_FrozenSave ( & f, fp ) ) {
+    perror ( "hashbench: Hash_FrozenSave" ) ;
+    exit ( 1 ) ;
+  }
+  Hash_FrozenFree ( & f ) ;
+  rewind ( fp ) ;
+  if ( 0 > Hash_FrozenLoad ( & f, fp ) ) {
+    perror ( "hashbench: Hash_FrozenLoad" ) ;
+    exit ( 1 ) ;
+  }
+  (void) fclose ( fp ) ;
+
+  for ( i = 0 ; i < n ; ++ i ) {
+    slot = Hash_FrozenFind ( & f, keys [ i ] ) ;
+    if ( 0 > slot || strcmp ( Hash_FrozenKey ( & f, slot ), keys [ i ] ) ) {
+      fprintf ( stderr, "hashbench: %s %lu: frozen key %s not found\n",
+        set_names [ set ], n, keys [ i ] ) ;
+      exit ( 1 ) ;
+    }
+  }
+  Hash_FrozenFree ( & f ) ;
+
+  for ( r = 0 ; r < reps ; ++ r ) {
+    if ( r ) { fill ( & t, keys, ents, n ) ; }
+    t0 = now_ns () ;
+    for ( i = 0 ; i < n ; ++ i ) {
+      Hash_DeleteEntry ( & t, ents [ perm [ i ] ] ) ;
+    }
+    del += now_ns () - t0 ;
+    Hash_DeleteTable ( & t ) ;
+  }
+
+  /* every hit (twice) and every enumerated entry, and no miss */
+  if ( found != 3 * reps * n ) {
+    fprintf ( stderr, "hashbench: %s %lu: %lu entries found\n",
+      set_names [ set ], n, found ) ;
+    exit ( 1 ) ;
+  }
+
+  bench_shared ( set, keys, miss, perm, n, reps, sh ) ;
+
+  printf ( "%-10s %8lu %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f"
+    " %8.1f %8.1f %8.1f\n",
+    set_names [ set ], n, ins / ( reps * n ), hit / ( reps * n ),
+    mis / ( reps * n ), del / ( reps * n ), en / ( reps * n ),
+    (double) bytes / n, frz / ( reps * n ), fhit / ( reps * n ),
+    fmis / ( reps * n ), sh [ 0 ], sh [ 1 ], sh [ 2 ] ) ;
+
+  free ( perm ) ;
+  free ( ents ) ;
+  free_keys ( miss, n ) ;
+  free_keys ( keys, n ) ;
+}
+
+int main ( const int argc, char ** argv )
+{
+  int i, set ;
+  unsigned long int n ;
+
+#ifdef HASH_OPEN_ADDRESSING
+  puts ( "backend: open addressing (hashoa.c)" ) ;
+#else
+  puts ( "backend: chained buckets (hash.c)" ) ;
+#endif
+  printf ( "%-10s %8s %8s %8s %8s %8s %8s %8s %8s %8s %8s %8s %8s %8s\n",
+    "keys", "size",
+    "insert", "hit", "miss", "delete", "enum", "bytes", "freeze", "f-hit",
+    "f-miss", "s-insert", "s-hit", "s-miss" ) ;
+
+  for ( set = 0 ; set < 3 ; ++ set ) {
+    if ( 1 < argc ) {
+      for ( i = 1 ; i < argc ; ++ i ) {
+        n = strtoul ( argv [ i ], NULL, 10 ) ;
+        if ( 0 < n ) { bench ( set, n ) ; }
+      }
+    } else {
+      for ( i = 0 ; i < (int) ( sizeof ( default_sizes )
+        / sizeof ( default_sizes [ 0 ] ) ) ; ++ i )
+      { bench ( set, default_sizes [ i ] ) ; }
+    }
+  }
+
+  return 0 ;
+}
@@ -0,0 +1,416 @@
+/*
+ * hashfrozen.c --
+ *
+ *	Frozen hash tables: read-only copies of a Hash_Table as a
+ *	perfect hash, for tables that are built once and then only
+ *	looked up.  This works the same on top of either backend of
+ *	hash.h, it only enumerates the table it freezes.
+ *
+ *	The keys are spread over numBuckets buckets, about 4 keys to a
+ *	bucket, by the low half of their Hash_Mix (the high half is the
+ *	check hash).  Every bucket gets a displacement d, the slot of a
+ *	key is then a second hash of its own hash and d.  The buckets
+ *	are placed largest first, each trying d = 0, 1, 2, ...
+ *	until all its keys land on free slots (hash and displace, as in
+ *	CHD).  A lookup is one hash, one displacement and one compare of
+ *	the key in the slot it maps to, a check hash in the slot saves
+ *	most of the string compares for keys that are not there.
+ *
+ *	Everything but the client data is kept in one block of 32 bit
+ *	offsets and key strings, which is also the file format after a
+ *	small header.  The file is in host byte order, it is meant for
+ *	caches on the same machine.
+ */
+
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef __linux__
+#  include <util.h>
+#endif
+
+#include "hash.h"
+
+#define	FROZEN_MAGIC	"HashFrz1"
+#define	FROZEN_MAGIC_LEN	8
+
+/*
+ * Average number of keys in a bucket.  More keys per bucket take
+ * less space for displacements but longer to place.
+ */
+
+#define	bucketLoad	4
+
+/*
+ * Number of times the placement is tried again with more slots
+ * when some bucket found no displacement.
+ */
+
+#define	maxAttempts	8
+
+static unsigned FrozenSlot(unsigned long long, unsigned, unsigned);
+static int Displace(Hash_Frozen *, const unsigned long long *, unsigned,
+    unsigned *);
+static size_t BlockSize(const Hash_Frozen *);
+static void AllocBlock(Hash_Frozen *);
+
+/*
+ *---------------------------------------------------------
+ *
+ * FrozenSlot --
+ *
+ *	The slot of a key with hash h in a bucket displaced by d.
+ *
+ *---------------------------------------------------------
+ */
+
+static unsigned
+FrozenSlot(unsigned long long h, unsigned d, unsigned numSlots)
+{
+
+	h = (h ^ (d * 0x9e3779b97f4a7c15ULL)) * 0xd6e8feb86659fd93ULL;
+	return ((unsigned) (h >> 32) % numSlots);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_Freeze --
+ *
+ *	Makes a frozen copy of a table.  The table is not changed
+ *	and may be deleted afterwards.
+ *
+ * Input:
+ *	t	Table to freeze.
+ *	f	Structure to hold the frozen table.
+ *
+ * Results:
+ *	0, or -1 if no perfect hash was found (which takes two keys
+ *	with the same 64 bit hash).  f is only set up on success.
+ *
+ * Side Effects:
+ *	Memory is allocated for the frozen table, to be released
+ *	with Hash_FrozenFree.
+ *
+ *---------------------------------------------------------
+ */
+
+int
+Hash_Freeze(Hash_Table *t, Hash_Frozen *f)
+{
+	Hash_Search search;
+	Hash_Entry *e, **ents;
+	unsigned long long *hashes;
+	unsigned *slotOf;
+	unsigned i, n, off, attempt;
+	size_t len;
+
+	n = t->numEntries;
+	ents = (Hash_Entry **) emalloc(sizeof(*ents) * (n + 1));
+	hashes = (unsigned long long *) emalloc(sizeof(*hashes) * (n + 1));
+	slotOf = (unsigned *) emalloc(sizeof(*slotOf) * (n + 1));
+
+	f->namesLen = 1;
+	for (i = 0, e = Hash_EnumFirst(t, &search); e != NULL && i < n;
+	     e = Hash_EnumNext(&search), i++) {
+		ents[i] = e;
+		hashes[i] = Hash_Mix(e->name, &len);
+		f->namesLen += len + 1;
+	}
+
+	f->numEntries = n;
+	f->numBuckets = n / bucketLoad + 1;
+	f->numSlots = n + n / 100 + 1;
+	for (attempt = 0;; attempt++) {
+		AllocBlock(f);
+		if (Displace(f, hashes, n, slotOf) == 0)
+			break;
+		free(f->dispPtr);
+		if (attempt + 1 == maxAttempts) {
+			free(ents);
+			free(hashes);
+			free(slotOf);
+			f->dispPtr = NULL;
+			return (-1);
+		}
+		f->numSlots += f->numSlots / 16 + 1;
+	}
+
+	f->valuePtr = (void **) emalloc(sizeof(void *) * f->numSlots);
+	(void) memset(f->valuePtr, 0, sizeof(void *) * f->numSlots);
+	for (i = 0, off = 0; i < n; i++) {
+		len = strlen(ents[i]->name) + 1;
+		(void) memcpy(f->names + off, ents[i]->name, len);
+		f->keyPtr[slotOf[i]] = off;
+		f->hashPtr[slotOf[i]] = (unsigned) (hashes[i] >> 32);
+		f->valuePtr[slotOf[i]] = ents[i]->clientData;
+		off += len;
+	}
+	f->names[off] = '\0';
+
+	free(ents);
+	free(hashes);
+	free(slotOf);
+	return (0);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Displace --
+ *	Finds a displacement for every bucket, so each key gets
+ *	a slot of its own, and records the slot of key i in
+ *	slotOf[i].
+ *
+ * Results:
+ *	0, or -1 if some bucket ran out of displacements to try.
+ *
+ *---------------------------------------------------------
+ */
+
+static int
+Displace(Hash_Frozen *f, const unsigned long long *hashes, unsigned n,
+    unsigned *slotOf)
+{
+	const unsigned nb = f->numBuckets, m = f->numSlots;
+	const unsigned maxTries = 4 * m + 65536;
+	unsigned *start, *keys, *order, *bySize;
+	unsigned char *used;
+	unsigned b, i, j, k, d, s, size, maxSize;
+	int res = 0;
+
+	/* the keys of bucket b are keys[start[b] .. start[b + 1] - 1] */
+	start = (unsigned *) emalloc(sizeof(*start) * (nb + 1));
+	keys = (unsigned *) emalloc(sizeof(*keys) * (n + 1));
+	(void) memset(start, 0, sizeof(*start) * (nb + 1));
+	for (i = 0; i < n; i++)
+		start[(unsigned) hashes[i] % nb + 1]++;
+	for (b = 0, maxSize = 0; b < nb; b++) {
+		if (start[b + 1] > maxSize)
+			maxSize = start[b + 1];
+		start[b + 1] += start[b];
+	}
+	order = (unsigned *) emalloc(sizeof(*order) * (nb + 1));
+	(void) memcpy(order, start, sizeof(*order) * nb);
+	for (i = 0; i < n; i++)
+		keys[order[(unsigned) hashes[i] % nb]++] = i;
+
+	/* the buckets by falling size, a counting sort */
+	bySize = (unsigned *) emalloc(sizeof(*bySize) * (maxSize + 2));
+	(void) memset(bySize, 0, sizeof(*bySize) * (maxSize + 2));
+	for (b = 0; b < nb; b++)
+		bySize[maxSize - (start[b + 1] - start[b]) + 1]++;
+	for (size = 0; size <= maxSize; size++)
+		bySize[size + 1] += bySize[size];
+	for (b = 0; b < nb; b++)
+		order[bySize[maxSize - (start[b + 1] - start[b])]++] = b;
+
+	used = (unsigned char *) emalloc(m);
+	(void) memset(used, 0, m);
+	for (i = 0; i < nb && res == 0; i++) {
+		b = order[i];
+		size = start[b + 1] - start[b];
+		f->dispPtr[b] = 0;
+		if (size == 0)
+			continue;
+		for (d = 0; d < maxTries; d++) {
+			for (j = 0; j < size; j++) {
+				k = keys[start[b] + j];
+				s = FrozenSlot(hashes[k], d, m);
+				if (used[s])
+					break;
+				used[s] = 1;
+				slotOf[k] = s;
+			}
+			if (j == size)
+				break;
+			while (j-- > 0)
+				used[slotOf[keys[start[b] + j]]] = 0;
+		}
+		if (d == maxTries)
+			res = -1;
+		f->dispPtr[b] = d;
+	}
+
+	free(used);
+	free(bySize);
+	free(order);
+	free(keys);
+	free(start);
+	return (res);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_FrozenFind --
+ *
+ * 	Searches a frozen table for key.
+ *
+ * Results:
+ *	The slot of key, or -1 if key is not in the table.
+ *
+ * Side Effects:
+ *	None.
+ *
+ *---------------------------------------------------------
+ */
+
+int
+Hash_FrozenFind(const Hash_Frozen *f, const char *key)
+{
+	size_t len;
+	const unsigned long long h = Hash_Mix(key, &len);
+	unsigned s;
+
+	s = FrozenSlot(h, f->dispPtr[(unsigned) h % f->numBuckets],
+	    f->numSlots);
+	if (f->hashPtr[s] != (unsigned) (h >> 32) || f->keyPtr[s] == ~0U ||
+	    strcmp(f->names + f->keyPtr[s], key) != 0)
+		return (-1);
+	return ((int) s);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_FrozenSave --
+ *
+ *	Writes a frozen table to fp, at its current position.
+ *	The client data is not written.
+ *
+ * Results:
+ *	0, or -1 if writing failed.
+ *
+ *---------------------------------------------------------
+ */
+
+int
+Hash_FrozenSave(const Hash_Frozen *f, FILE *fp)
+{
+	unsigned hdr[4];
+
+	hdr[0] = f->numEntries;
+	hdr[1] = f->numSlots;
+	hdr[2] = f->numBuckets;
+	hdr[3] = f->namesLen;
+	if (fwrite(FROZEN_MAGIC, FROZEN_MAGIC_LEN, 1, fp) != 1 ||
+	    fwrite(hdr, sizeof(hdr), 1, fp) != 1 ||
+	    fwrite(f->dispPtr, BlockSize(f), 1, fp) != 1)
+		return (-1);
+	return (0);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_FrozenLoad --
+ *
+ *	Reads a frozen table written by Hash_FrozenSave from fp,
+ *	at its current position.  All the client data is NULL.
+ *
+ * Results:
+ *	0, or -1 if fp holds no (sane) frozen table.  f is only
+ *	set up on success.
+ *
+ * Side Effects:
+ *	Memory is allocated for the frozen table, to be released
+ *	with Hash_FrozenFree.
+ *
+ *---------------------------------------------------------
+ */
+
+int
+Hash_FrozenLoad(Hash_Frozen *f, FILE *fp)
+{
+	char magic[FROZEN_MAGIC_LEN];
+	unsigned hdr[4], i;
+
+	if (fread(magic, sizeof(magic), 1, fp) != 1 ||
+	    memcmp(magic, FROZEN_MAGIC, sizeof(magic)) != 0 ||
+	    fread(hdr, sizeof(hdr), 1, fp) != 1)
+		return (-1);
+
+	/* the sizes Hash_Freeze would have chosen, or larger */
+	if (hdr[1] <= hdr[0] || hdr[1] > (1U << 28) ||
+	    hdr[2] != hdr[0] / bucketLoad + 1 ||
+	    hdr[3] == 0 || hdr[3] > (1U << 30))
+		return (-1);
+	f->numEntries = hdr[0];
+	f->numSlots = hdr[1];
+	f->numBuckets = hdr[2];
+	f->namesLen = hdr[3];
+	AllocBlock(f);
+	if (fread(f->dispPtr, BlockSize(f), 1, fp) != 1 ||
+	    f->names[f->namesLen - 1] != '\0')
+		goto bad;
+	for (i = 0; i < f->numSlots; i++)
+		if (f->keyPtr[i] != ~0U && f->keyPtr[i] >= f->namesLen)
+			goto bad;
+
+	f->valuePtr = (void **) emalloc(sizeof(void *) * f->numSlots);
+	(void) memset(f->valuePtr, 0, sizeof(void *) * f->numSlots);
+	return (0);
+
+bad:
+	free(f->dispPtr);
+	f->dispPtr = NULL;
+	return (-1);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_FrozenFree --
+ *
+ *	Frees the memory of a frozen table (except for the
+ *	Hash_Frozen structure).
+ *
+ *---------------------------------------------------------
+ */
+
+void
+Hash_FrozenFree(Hash_Frozen *f)
+{
+
+	free(f->dispPtr);
+	free(f->valuePtr);
+	f->dispPtr = f->hashPtr = f->keyPtr = NULL;
+	f->names = NULL;
+	f->valuePtr = NULL;
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * BlockSize, AllocBlock --
+ *	The size of the block of a frozen table, and allocating
+ *	it with all slots free: the displacements, then the
+ *	check hashes and the key offsets of the slots, then the
+ *	key strings.
+ *
+ *---------------------------------------------------------
+ */
+
+static size_t
+BlockSize(const Hash_Frozen *f)
+{
+
+	return (sizeof(unsigned) * ((size_t) f->numBuckets +
+	    2 * (size_t) f->numSlots) + f->namesLen);
+}
+
+static void
+AllocBlock(Hash_Frozen *f)
+{
+
+	f->dispPtr = (unsigned *) emalloc(BlockSize(f));
+	f->hashPtr = f->dispPtr + f->numBuckets;
+	f->keyPtr = f->hashPtr + f->numSlots;
+	f->names = (char *) (f->keyPtr + f->numSlots);
+	(void) memset(f->hashPtr, 0, sizeof(unsigned) * f->numSlots);
+	(void) memset(f->keyPtr, 0xff, sizeof(unsigned) * f->numSlots);
+}
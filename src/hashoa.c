@@ -0,0 +1,507 @@
+/*
+ * hashoa.c --
+ *
+ *	An open addressing backend for the hash module, a drop-in
+ *	replacement for hash.c behind the same Hash_* interface.
+ *	Build everything that includes hash.h with -DHASH_OPEN_ADDRESSING
+ *	and link this file instead of hash.c.
+ *
+ *	The table is a power of two slots with linear probing and Robin
+ *	Hood insertion: an entry that is further from its home slot takes
+ *	the place of one that is closer to its own, which keeps the probe
+ *	sequences short and lets a lookup stop as soon as it meets an entry
+ *	closer to home than the key would be.  Deletion shifts the entries
+ *	after the hole back by one, so there are no tombstones.  The table
+ *	grows at 7/8 load.
+ *
+ *	The hashes of the slots live in their own array, a probe only
+ *	touches the entry when the full 32 bit hash matches, and the key
+ *	length cached in the entry settles most of those with a memcmp.
+ *	The keys are hashed with Hash_Mix, 8 bytes at a time with a
+ *	multiply and xor-shift mixer, which spreads keys like "p1", "p2",
+ *	... or paths with a long common prefix far better than h * 31 + c.
+ */
+
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef __linux__
+#  include <util.h>
+#endif
+
+#ifndef HASH_OPEN_ADDRESSING
+#  define HASH_OPEN_ADDRESSING
+#endif
+#include "hash.h"
+
+static unsigned HashKey(const char *, unsigned *);
+static void PlaceEntry(Hash_Table *, int, unsigned, unsigned, Hash_Entry *);
+static void RebuildTable(Hash_Table *, int);
+static void AllocSlots(Hash_Table *, int);
+
+/*
+ * The table is rebuilt twice as large once it is more than
+ * loadNum / loadDen full.
+ */
+
+#define loadNum	7
+#define loadDen	8
+
+/*
+ * The most slots Hash_ReserveTable asks for, so that the load
+ * arithmetic on its size cannot overflow an int.
+ */
+
+#define maxSize	(1 << 28)
+
+/* the distance of the entry with hash h in slot i from its home slot */
+#define	PROBE_DIST(t, i, h)	(((unsigned) (i) - (h)) & (t)->mask)
+
+/*
+ *---------------------------------------------------------
+ *
+ * HashKey --
+ *
+ *	Hashes a key with Hash_Mix and finds its length.  The
+ *	result is never 0, that value marks the empty slots.
+ *
+ *---------------------------------------------------------
+ */
+
+static unsigned
+HashKey(const char *key, unsigned *lenPtr)
+{
+	size_t len;
+	const unsigned h = (unsigned) Hash_Mix(key, &len);
+
+	*lenPtr = len;
+	return (h ? h : 1);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_InitTable --
+ *
+ *	This routine just sets up the hash table.
+ *
+ * Input:
+ *	t		Structure to use to hold table.
+ *	numBuckets	How many slots to create for starters.  This number
+ *			is rounded up to a power of two.  If <= 0, a reasonable
+ *			default is chosen. The table will grow in size later
+ *			as needed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side Effects:
+ *	Memory is allocated for the initial slots.
+ *
+ *---------------------------------------------------------
+ */
+
+void
+Hash_InitTable(Hash_Table *t, int numBuckets)
+{
+	int i;
+
+	if (numBuckets <= 0)
+		i = 16;
+	else {
+		for (i = 2; i < numBuckets; i <<= 1)
+			 continue;
+	}
+	t->numEntries = 0;
+	AllocSlots(t, i);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_DeleteTable --
+ *
+ *	This routine removes everything from a hash table
+ *	and frees up the memory space it occupied (except for
+ *	the space in the Hash_Table structure).
+ *
+ * Results:
+ *	None.
+ *
+ * Side Effects:
+ *	Lots of memory is freed up.
+ *
+ *---------------------------------------------------------
+ */
+
+void
+Hash_DeleteTable(Hash_Table *t)
+{
+	int i;
+
+	for (i = 0; i < t->size; i++)
+		if (t->hashPtr[i] != 0)
+			free(t->entryPtr[i]);
+	free(t->hashPtr);
+
+	/*
+	 * Set up the hash table to cause memory faults on any future access
+	 * attempts until re-initialization.
+	 */
+	t->hashPtr = NULL;
+	t->entryPtr = NULL;
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_ReserveTable --
+ *
+ *	Makes room for numEntries entries in all, so a table that
+ *	is about to be filled with that many keys is not rebuilt
+ *	over and over while it grows.  The table never shrinks.
+ *
+ * Results:
+ *	None.
+ *
+ * Side Effects:
+ *	The table may be rebuilt with more slots.
+ *
+ *---------------------------------------------------------
+ */
+
+void
+Hash_ReserveTable(Hash_Table *t, int numEntries)
+{
+	int i;
+
+	if (numEntries > maxSize / loadDen * loadNum)
+		numEntries = maxSize / loadDen * loadNum;
+	for (i = t->size; numEntries * loadDen > i * loadNum; i <<= 1)
+		continue;
+	if (i > t->size)
+		RebuildTable(t, i);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_FindEntry --
+ *
+ * 	Searches a hash table for an entry corresponding to key.
+ *
+ * Input:
+ *	t	Hash table to search.
+ *	key	A hash key.
+ *
+ * Results:
+ *	The return value is a pointer to the entry for key,
+ *	if key was present in the table.  If key was not
+ *	present, NULL is returned.
+ *
+ * Side Effects:
+ *	None.
+ *
+ *---------------------------------------------------------
+ */
+
+Hash_Entry *
+Hash_FindEntry(Hash_Table *t, char *key)
+{
+	Hash_Entry *e;
+	unsigned h, hh, len, d;
+	int i;
+
+	h = HashKey(key, &len);
+	for (i = h & t->mask, d = 0;; i = (i + 1) & t->mask, d++) {
+		hh = t->hashPtr[i];
+		if (hh == 0 || PROBE_DIST(t, i, hh) < d)
+			return (NULL);
+		if (hh == h) {
+			e = t->entryPtr[i];
+			if (e->namelen == len && memcmp(e->name, key, len) == 0)
+				return (e);
+		}
+	}
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_CreateEntry --
+ *
+ *	Searches a hash table for an entry corresponding to
+ *	key.  If no entry is found, then one is created.
+ *
+ * Input:
+ * 	t	Hash table to search.
+ *	key	A hash key.
+ *	newPtr	Filled in with 1 if new entry created, 0 otherwise.
+ *
+ * Results:
+ *	The return value is a pointer to the entry.  If *newPtr
+ *	isn't NULL, then *newPtr is filled in with TRUE if a
+ *	new entry was created, and FALSE if an entry already existed
+ *	with the given key.
+ *
+ * Side Effects:
+ *	Memory may be allocated, and entries may move to other slots.
+ *---------------------------------------------------------
+ */
+
+Hash_Entry *
+Hash_CreateEntry(Hash_Table *t, char *key, int *newPtr)
+{
+	Hash_Entry *e;
+	unsigned h, hh, len, d;
+	int i;
+
+	h = HashKey(key, &len);
+	for (i = h & t->mask, d = 0;; i = (i + 1) & t->mask, d++) {
+		hh = t->hashPtr[i];
+		if (hh == 0 || PROBE_DIST(t, i, hh) < d)
+			break;
+		if (hh == h) {
+			e = t->entryPtr[i];
+			if (e->namelen == len &&
+			    memcmp(e->name, key, len) == 0) {
+				if (newPtr != NULL)
+					*newPtr = 0;
+				return (e);
+			}
+		}
+	}
+
+	e = (Hash_Entry *) emalloc(sizeof(*e) + len);
+	e->clientData = NULL;
+	e->namehash = h;
+	e->namelen = len;
+	(void) memcpy(e->name, key, len + 1);
+
+	/*
+	 * The probe stopped where the new entry belongs, unless the
+	 * table has to grow first.
+	 */
+	if ((t->numEntries + 1) * loadDen > t->size * loadNum) {
+		RebuildTable(t, t->size << 1);
+		PlaceEntry(t, h & t->mask, 0, h, e);
+	} else
+		PlaceEntry(t, i, d, h, e);
+	t->numEntries++;
+
+	if (newPtr != NULL)
+		*newPtr = 1;
+	return (e);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_DeleteEntry --
+ *
+ * 	Delete the given hash table entry and free memory associated with
+ *	it.
+ *
+ * Results:
+ *	None.
+ *
+ * Side Effects:
+ *	The entries probed after it move back one slot and memory
+ *	is freed.
+ *
+ *---------------------------------------------------------
+ */
+
+void
+Hash_DeleteEntry(Hash_Table *t, Hash_Entry *e)
+{
+	unsigned hh;
+	int i, j;
+
+	if (e == NULL)
+		return;
+	for (i = e->namehash & t->mask; t->entryPtr[i] != e;
+	     i = (i + 1) & t->mask) {
+		if (t->hashPtr[i] == 0) {
+			(void)write(2, "bad call to Hash_DeleteEntry\n", 29);
+			abort();
+		}
+	}
+
+	/*
+	 * Shift the rest of the probe sequence back over the hole, up to
+	 * an empty slot or an entry that is in its home slot.
+	 */
+	for (;; i = j) {
+		j = (i + 1) & t->mask;
+		hh = t->hashPtr[j];
+		if (hh == 0 || PROBE_DIST(t, j, hh) == 0)
+			break;
+		t->hashPtr[i] = hh;
+		t->entryPtr[i] = t->entryPtr[j];
+	}
+	t->hashPtr[i] = 0;
+	t->entryPtr[i] = NULL;
+	free(e);
+	t->numEntries--;
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_EnumFirst --
+ *	This procedure sets things up for a complete search
+ *	of all entries recorded in the hash table.
+ *
+ * Input:
+ *	t		Table to be searched.
+ *	searchPtr	Area in which to keep state about search.
+ *
+ * Results:
+ *	The return value is the address of the first entry in
+ *	the hash table, or NULL if the table is empty.
+ *
+ * Side Effects:
+ *	The information in searchPtr is initialized so that successive
+ *	calls to Hash_Next will return successive HashEntry's
+ *	from the table.
+ *
+ *---------------------------------------------------------
+ */
+
+Hash_Entry *
+Hash_EnumFirst(Hash_Table *t, Hash_Search *searchPtr)
+{
+
+	searchPtr->tablePtr = t;
+	searchPtr->nextIndex = 0;
+	searchPtr->hashEntryPtr = NULL;
+	return Hash_EnumNext(searchPtr);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_EnumNext --
+ *    This procedure returns successive entries in the hash table.
+ *
+ * Results:
+ *    The return value is a pointer to the next HashEntry
+ *    in the table, or NULL when the end of the table is
+ *    reached.
+ *
+ * Side Effects:
+ *    The information in searchPtr is modified to advance to the
+ *    next entry.
+ *
+ *---------------------------------------------------------
+ */
+
+Hash_Entry *
+Hash_EnumNext(Hash_Search *searchPtr)
+{
+	Hash_Table *t = searchPtr->tablePtr;
+	int i;
+
+	for (i = searchPtr->nextIndex; i < t->size; i++) {
+		if (t->hashPtr[i] != 0) {
+			searchPtr->nextIndex = i + 1;
+			return (searchPtr->hashEntryPtr = t->entryPtr[i]);
+		}
+	}
+	searchPtr->nextIndex = t->size;
+	return (searchPtr->hashEntryPtr = NULL);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * PlaceEntry --
+ *	Puts an entry with hash h into the table, starting at slot
+ *	i which is d slots from its home.  Entries closer to their
+ *	home are pushed further along.
+ *
+ *---------------------------------------------------------
+ */
+
+static void
+PlaceEntry(Hash_Table *t, int i, unsigned d, unsigned h, Hash_Entry *e)
+{
+	Hash_Entry *te;
+	unsigned hh, dd;
+
+	for (;; i = (i + 1) & t->mask, d++) {
+		hh = t->hashPtr[i];
+		if (hh == 0) {
+			t->hashPtr[i] = h;
+			t->entryPtr[i] = e;
+			return;
+		}
+		dd = PROBE_DIST(t, i, hh);
+		if (dd < d) {
+			te = t->entryPtr[i];
+			t->hashPtr[i] = h;
+			t->entryPtr[i] = e;
+			h = hh;
+			e = te;
+			d = dd;
+		}
+	}
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * AllocSlots --
+ *	Allocates n empty slots for a table, the hashes and the
+ *	entries in one block.
+ *
+ *---------------------------------------------------------
+ */
+
+static void
+AllocSlots(Hash_Table *t, int n)
+{
+	t->size = n;
+	t->mask = n - 1;
+	t->hashPtr = (unsigned *) emalloc((sizeof(unsigned) +
+	    sizeof(Hash_Entry *)) * n);
+	t->entryPtr = (Hash_Entry **) (t->hashPtr + n);
+	(void) memset(t->hashPtr, 0, sizeof(unsigned) * n);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * RebuildTable --
+ *	This local routine makes a new hash table that
+ *	is larger than the old one, with newSize slots.
+ *
+ * Results:
+ * 	None.
+ *
+ * Side Effects:
+ *	The entire hash table is moved, so any slot numbers
+ *	from the old table are invalid.
+ *
+ *---------------------------------------------------------
+ */
+
+static void
+RebuildTable(Hash_Table *t, int newSize)
+{
+	unsigned *oldHash = t->hashPtr;
+	Hash_Entry **oldEntry = t->entryPtr;
+	int i, oldSize = t->size;
+
+	AllocSlots(t, newSize);
+	for (i = 0; i < oldSize; i++)
+		if (oldHash[i] != 0)
+			PlaceEntry(t, oldHash[i] & t->mask, 0, oldHash[i],
+			    oldEntry[i]);
+	free(oldHash);
+}
@@ -0,0 +1,389 @@
+/*
+ * hashshared.c --
+ *
+ *	Shared hash tables, which any number of threads may look up
+ *	and add to at the same time, see hash.h.  They need no locks,
+ *	only the atomic builtins of gcc and clang: a thread adds an entry
+ *	(or a bucket's dummy node) by a compare and swap of the next
+ *	pointer of the node it goes after, and tries again from that node
+ *	when another thread got in first.  Since nodes are never taken off
+ *	the list, a node once reached stays valid and in place, and there
+ *	are no ABA problems.
+ *
+ *	The entries are ordinary Hash_Entry structures, so Hash_GetKey
+ *	works on them as usual.  Their client data is not synchronised:
+ *	Hash_SetValue on an entry other threads may be reading needs some
+ *	agreement of its own, such as setting it only from the thread that
+ *	created the entry before anyone else gets to look it up.
+ */
+
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef __linux__
+#  include <util.h>
+#endif
+
+#include "hash.h"
+
+/*
+ * A node on the list, an entry or the dummy node a bucket starts
+ * at.  The entry is last, its name runs on past the node.
+ */
+
+typedef struct Hash_SharedNode {
+	struct Hash_SharedNode *next;	/* Next node, by sortKey. */
+	unsigned	sortKey;	/* Bit-reversed hash, odd for
+					 * entries, even for dummies. */
+	Hash_Entry	entry;
+} Hash_SharedNode;
+
+/*
+ * The size is doubled when there are more than loadLimit entries
+ * per bucket, up to maxBuckets buckets.
+ */
+
+#define	loadLimit	2
+#define	maxBuckets	(1U << 30)
+
+#define	LOAD(p)		__atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define	STORE(p, v)	__atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define	CAS(p, o, n)	__atomic_compare_exchange_n(&(p), (o), (n), 0, \
+			    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+static unsigned Reverse(unsigned);
+static Hash_SharedNode *NewNode(unsigned, unsigned, const char *, size_t);
+static Hash_SharedNode **BucketSlot(Hash_Shared *, unsigned);
+static Hash_SharedNode *GetBucket(Hash_Shared *, unsigned);
+static Hash_SharedNode *ListFind(Hash_SharedNode *, unsigned, unsigned,
+    const char *);
+static Hash_SharedNode *ListInsert(Hash_SharedNode *, Hash_SharedNode *,
+    int *);
+
+/* the sort key of an entry with hash h */
+#define	ENTRY_KEY(h)	Reverse((h) | 0x80000000U)
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_InitShared --
+ *
+ *	Sets up a shared table.  This and Hash_DeleteShared
+ *	must not run alongside other calls on the table.
+ *
+ * Input:
+ *	t		Structure to use to hold table.
+ *	numBuckets	How many buckets to use for starters.  This number
+ *			is rounded up to a power of two.  If <= 0, a reasonable
+ *			default is chosen.  Buckets are set up when first used.
+ *
+ *---------------------------------------------------------
+ */
+
+void
+Hash_InitShared(Hash_Shared *t, int numBuckets)
+{
+	unsigned i;
+
+	if (numBuckets <= 0)
+		i = 16;
+	else {
+		for (i = 2; i < (unsigned) numBuckets && i < maxBuckets;
+		     i <<= 1)
+			continue;
+	}
+	(void) memset(t->segPtr, 0, sizeof(t->segPtr));
+	t->size = i;
+	t->numEntries = 0;
+	*BucketSlot(t, 0) = NewNode(0, 0, "", 0);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_DeleteShared --
+ *
+ *	Frees all entries and buckets of a shared table (except
+ *	for the Hash_Shared structure).
+ *
+ *---------------------------------------------------------
+ */
+
+void
+Hash_DeleteShared(Hash_Shared *t)
+{
+	Hash_SharedNode *n, *next;
+	int s;
+
+	for (n = *BucketSlot(t, 0); n != NULL; n = next) {
+		next = n->next;
+		free(n);
+	}
+	for (s = 0; s < HASH_SHARED_SEGMENTS; s++) {
+		free(t->segPtr[s]);
+		t->segPtr[s] = NULL;
+	}
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_SharedFind --
+ *
+ * 	Searches a shared table for an entry corresponding to key.
+ *
+ * Results:
+ *	The entry for key, or NULL if key is not in the table.
+ *
+ * Side Effects:
+ *	The bucket of key may be set up.
+ *
+ *---------------------------------------------------------
+ */
+
+Hash_Entry *
+Hash_SharedFind(Hash_Shared *t, const char *key)
+{
+	Hash_SharedNode *n;
+	size_t len;
+	const unsigned h = (unsigned) Hash_Mix(key, &len);
+
+	n = ListFind(GetBucket(t, h & (LOAD(t->size) - 1)), ENTRY_KEY(h), h,
+	    key);
+	return (n != NULL ? &n->entry : NULL);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Hash_SharedCreate --
+ *
+ *	Searches a shared table for an entry corresponding to
+ *	key.  If no entry is found, then one is created.  When
+ *	several threads create the same key at once, one of them
+ *	creates it and all get the same entry.
+ *
+ * Input:
+ * 	t	Shared table to search.
+ *	key	A hash key.
+ *	newPtr	Filled in with 1 if new entry created, 0 otherwise.
+ *
+ * Results:
+ *	The entry for key.
+ *
+ * Side Effects:
+ *	Memory may be allocated, and the table may grow.
+ *
+ *---------------------------------------------------------
+ */
+
+Hash_Entry *
+Hash_SharedCreate(Hash_Shared *t, const char *key, int *newPtr)
+{
+	Hash_SharedNode *bucket, *n, *node;
+	size_t len;
+	const unsigned h = (unsigned) Hash_Mix(key, &len);
+	unsigned size = LOAD(t->size);
+	int new;
+
+	bucket = GetBucket(t, h & (size - 1));
+	if ((n = ListFind(bucket, ENTRY_KEY(h), h, key)) != NULL) {
+		if (newPtr != NULL)
+			*newPtr = 0;
+		return (&n->entry);
+	}
+
+	node = NewNode(ENTRY_KEY(h), h, key, len);
+	n = ListInsert(bucket, node, &new);
+	if (!new)
+		free(node);
+	else if (__atomic_add_fetch(&t->numEntries, 1, __ATOMIC_RELAXED) >
+	    loadLimit * size && size < maxBuckets)
+		(void) CAS(t->size, &size, size << 1);
+
+	if (newPtr != NULL)
+		*newPtr = new;
+	return (&n->entry);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * Reverse --
+ *	The bits of x in reverse order.
+ *
+ *---------------------------------------------------------
+ */
+
+static unsigned
+Reverse(unsigned x)
+{
+
+	x = ((x >> 1) & 0x55555555U) | ((x & 0x55555555U) << 1);
+	x = ((x >> 2) & 0x33333333U) | ((x & 0x33333333U) << 2);
+	x = ((x >> 4) & 0x0f0f0f0fU) | ((x & 0x0f0f0f0fU) << 4);
+	x = ((x >> 8) & 0x00ff00ffU) | ((x & 0x00ff00ffU) << 8);
+	return ((x >> 16) | (x << 16));
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * NewNode --
+ *	A new node, not yet on the list.
+ *
+ *---------------------------------------------------------
+ */
+
+static Hash_SharedNode *
+NewNode(unsigned sortKey, unsigned h, const char *key, size_t len)
+{
+	Hash_SharedNode *n;
+
+	n = (Hash_SharedNode *) emalloc(sizeof(*n) + len);
+	n->next = NULL;
+	n->sortKey = sortKey;
+	n->entry.clientData = NULL;
+	n->entry.namehash = h;
+#ifdef HASH_OPEN_ADDRESSING
+	n->entry.namelen = len;
+#else
+	n->entry.next = NULL;
+#endif
+	(void) memcpy(n->entry.name, key, len + 1);
+	return (n);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * BucketSlot --
+ *	Where the pointer to the dummy node of bucket b is kept,
+ *	allocating its segment if nobody did so yet.
+ *
+ *---------------------------------------------------------
+ */
+
+static Hash_SharedNode **
+BucketSlot(Hash_Shared *t, unsigned b)
+{
+	const int s = b ? 32 - __builtin_clz(b) : 0;
+	const unsigned first = s ? 1U << (s - 1) : 0;
+	Hash_SharedNode **seg, **new;
+
+	if ((seg = LOAD(t->segPtr[s])) == NULL) {
+		new = (Hash_SharedNode **) emalloc(sizeof(*new) *
+		    (first ? first : 1));
+		(void) memset(new, 0, sizeof(*new) * (first ? first : 1));
+		if (CAS(t->segPtr[s], &seg, new))
+			seg = new;
+		else
+			free(new);
+	}
+	return (&seg[b - first]);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * GetBucket --
+ *	The dummy node of bucket b.  A bucket not used before
+ *	gets its dummy node put on the list first, after the one
+ *	of its parent bucket (b without its top bit) which holds
+ *	the entries of b as long as b is not set up.
+ *
+ *---------------------------------------------------------
+ */
+
+static Hash_SharedNode *
+GetBucket(Hash_Shared *t, unsigned b)
+{
+	Hash_SharedNode **bp = BucketSlot(t, b), *dummy, *node;
+	int new;
+
+	if ((dummy = LOAD(*bp)) != NULL)
+		return (dummy);
+
+	node = NewNode(Reverse(b), 0, "", 0);
+	dummy = ListInsert(GetBucket(t, b & ~(0x80000000U >> __builtin_clz(b))),
+	    node, &new);
+	if (!new)
+		free(node);
+	STORE(*bp, dummy);
+	return (dummy);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * ListFind --
+ *	Looks for the entry of key, with hash h and sort key
+ *	sortKey, on the list after node prev.
+ *
+ *---------------------------------------------------------
+ */
+
+static Hash_SharedNode *
+ListFind(Hash_SharedNode *prev, unsigned sortKey, unsigned h,
+    const char *key)
+{
+	Hash_SharedNode *n;
+
+	for (n = LOAD(prev->next); n != NULL && n->sortKey <= sortKey;
+	     n = LOAD(n->next))
+		if (n->sortKey == sortKey && n->entry.namehash == h &&
+		    strcmp(n->entry.name, key) == 0)
+			return (n);
+	return (NULL);
+}
+
+/*
+ *---------------------------------------------------------
+ *
+ * ListInsert --
+ *	Puts node on the list after node prev, in its place by
+ *	sortKey, unless an equal node is there already.
+ *
+ * Results:
+ *	The node now on the list, *newPtr tells whether it is
+ *	the one given.
+ *
+ *---------------------------------------------------------
+ */
+
+static Hash_SharedNode *
+ListInsert(Hash_SharedNode *prev, Hash_SharedNode *node, int *newPtr)
+{
+	Hash_SharedNode *cur, *n;
+
+	for (;;) {
+		cur = LOAD(prev->next);
+		while (cur != NULL && cur->sortKey < node->sortKey) {
+			prev = cur;
+			cur = LOAD(cur->next);
+		}
+
+		/*
+		 * Dummies with the same sort key are the same bucket,
+		 * entries only hash alike.
+		 */
+		for (n = cur; n != NULL && n->sortKey == node->sortKey;
+		     n = LOAD(n->next)) {
+			if ((node->sortKey & 1) == 0 ||
+			    (n->entry.namehash == node->entry.namehash &&
+			    strcmp(n->entry.name, node->entry.name) == 0)) {
+				*newPtr = 0;
+				return (n);
+			}
+		}
+
+		node->next = cur;
+		if (CAS(prev->next, &cur, node)) {
+			*newPtr = 1;
+			return (node);
+		}
+	}
+}
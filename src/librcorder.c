@@ -0,0 +1,2402 @@
+/*	$NetBSD: rcorder.c,v 1.18 2016/09/05 01:09:57 sevan Exp $	*/
+
+/*
+ * Copyright (c) 2016, 2017 Vaios
+ *
+ * Modyfied and ported to Linux.
+ *
+ * The parser and orderer of rcorder as a library, see rcorder.h for
+ * its interface.  rcorder.c is the command line front end to it and
+ * lists the changes made to NetBSD's original code.
+ */
+
+/*
+ * Copyright (c) 1998, 1999 Matthew R. Green
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Copyright (c) 1998
+ * 	Perry E. Metzger.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *	This product includes software developed for the NetBSD Project
+ *	by Perry E. Metzger.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#  include <sys/syscall.h>
+#else
+#  include <util.h>
+#endif
+
+#include "hash.h"
+#include "rcorder.h"
+
+/* header lines start with this unless -c gives another prefix */
+#define COMMENT_STR		"# "
+#define COMMENT_LEN		(sizeof ( COMMENT_STR ) - 1)
+/* bytes read up front, header blocks usually end within them */
+#define HEAD_CHUNK		4096
+#define REQUIRE_STR		"REQUIRE:"
+#define REQUIRE_LEN		(sizeof ( REQUIRE_STR ) - 1)
+#define REQUIRES_STR		"REQUIRES:"
+#define REQUIRES_LEN		(sizeof ( REQUIRES_STR ) - 1)
+#define PROVIDE_STR		"PROVIDE:"
+#define PROVIDE_LEN		(sizeof ( PROVIDE_STR ) - 1)
+#define PROVIDES_STR		"PROVIDES:"
+#define PROVIDES_LEN		(sizeof ( PROVIDES_STR ) - 1)
+#define BEFORE_STR		"BEFORE:"
+#define BEFORE_LEN		(sizeof ( BEFORE_STR ) - 1)
+#define KEYWORD_STR		"KEYWORD:"
+#define KEYWORD_LEN		(sizeof ( KEYWORD_STR ) - 1)
+#define KEYWORDS_STR		"KEYWORDS:"
+#define KEYWORDS_LEN		(sizeof ( KEYWORDS_STR ) - 1)
+#define CACHE_MAGIC		"rcorder-cache 1"
+#ifdef __linux__
+#  define ST_MTIME_NSEC(st)	((long) (st) -> st_mtim . tv_nsec)
+#else
+#  define ST_MTIME_NSEC(st)	0L
+#endif
+/* size of the first arena block, later ones double up to the max */
+#define ARENA_MIN		( 64 * 1024 )
+#define ARENA_MAX		( 4 * 1024 * 1024 )
+/* parse threads unless rcorder_threads() says otherwise, and at most */
+#define PARSE_THREADS		4
+#define PARSE_THREADS_MAX	64
+/* files per parse thread below which it is not worth starting it */
+#define PARSE_PER_THREAD	32
+/* shell used to run the scripts in execution mode (-x) */
+#define RC_SHELL		"/bin/sh"
+
+enum {
+  RESET	= 0,
+  SET	= 1
+} ;
+
+typedef struct provnode provnode ;
+typedef struct filenode filenode ;
+typedef struct f_provnode f_provnode ;
+typedef struct f_reqnode f_reqnode ;
+typedef struct f_depnode f_depnode ;
+typedef struct strnodelist strnodelist ;
+typedef struct hdrbuf hdrbuf ;
+typedef struct arenablk arenablk ;
+typedef struct cachent cachent ;
+typedef struct rcinput rcinput ;
+
+struct provnode {
+	int		head ;
+	filenode	* fnode ;
+	provnode	* next, * last ;
+} ;
+
+struct f_provnode {
+	provnode	* pnode ;
+	f_provnode	* next ;
+} ;
+
+struct f_reqnode {
+	Hash_Entry	* entry ;
+	f_reqnode	* next ;
+} ;
+
+/* a file that has to wait for the file owning this list */
+struct f_depnode {
+	filenode	* node ;
+	f_depnode	* next ;
+} ;
+
+struct strnodelist {
+	filenode	* node ;
+	strnodelist	* next ;
+	char		s [ 1 ] ;
+} ;
+
+/*
+ * one block of the arena all graph nodes are allocated from.
+ * the union only makes data suitably aligned for any node.
+ */
+struct arenablk {
+	arenablk	* next ;
+	size_t		used, size ;
+	union {
+		long double	ld ;
+		long long	ll ;
+		void		* p ;
+	} data [ 1 ] ;
+} ;
+
+/* a header record being built */
+struct hdrbuf {
+	char		* s ;
+	size_t		len, size ;
+} ;
+
+/* one file of the parse cache */
+struct cachent {
+	unsigned long long	dev, ino ;
+	long long	size, sec ;
+	long		nsec ;
+	int		used ;		/* seen in this run */
+	char		* hdr ;		/* header record */
+} ;
+
+/*
+ * a file to parse.  path names it in the output, name is the same
+ * file relative to the directory dfd it is opened with.
+ */
+struct rcinput {
+	char		* path ;
+	const char	* name ;
+	int		dfd ;
+	int		state ;
+	int		top ;		/* given by the user */
+	char		* hdr ;		/* header record */
+	cachent		* ce ;		/* cache entry hdr is from */
+	struct stat	st ;
+} ;
+
+enum {
+  IN_NEW	= 0,
+  IN_DIR	= 1,
+  IN_BAD	= 2,
+  IN_OK		= 3
+} ;
+
+struct filenode {
+	char		* filename ;
+	int		id ;		/* command line position */
+	int		done ;
+	int		level ;
+	filenode	* next ;
+	int		nprov ;		/* providers, as linked */
+	int		npending ;	/* providers not yet finished */
+	pid_t		pid ;
+	f_depnode	* dep_list ;
+	f_depnode	* bef_list ;	/* files BEFORE: this one */
+	f_reqnode	* req_list ;
+	f_provnode	* prov_list ;
+	unsigned long	* kw_bits ;	/* keywords of -k/-s, or NULL */
+} ;
+
+/*
+ * the context.  the graph (file, provision, requirement and dependant
+ * nodes, file names and word lists) lives in its arena.
+ *
+ * the keywords given to -k and -s are interned into keyword_hash,
+ * numbered from 0 on.  files and the two lists keep bitsets of them
+ * (kw_words words each), keywords no list mentions are not kept.
+ */
+struct rcorder {
+	int		exit_code ;
+	int		file_count ;
+	int		node_count ;
+	int		threads ;
+	int		jobs ;
+	int		loaded ;
+	int		linked ;
+	int		cache_dirty ;
+	const char	* comment ;
+	const char	* cache_file ;
+	const char	* run_arg ;
+	double		parse_secs, before_secs ;
+	arenablk	* arena ;
+	Hash_Table	provide_hash_s, * provide_hash ;
+	Hash_Table	cache_hash_s, * cache_hash ;
+	Hash_Table	keyword_hash_s, * keyword_hash ;
+	/* the files to parse, in command line order */
+	rcinput		* inputs ;
+	int		input_count, input_size ;
+	int		next_input ;
+	/* directories given, their files are opened relative to them */
+	int		* dir_fds ;
+	int		dir_count ;
+	/* the files in command line order */
+	filenode	fn_head_s, * fn_head ;
+	filenode	* fn_tail ;
+	strnodelist	* bl_list ;
+	strnodelist	* keep_list ;
+	strnodelist	* skip_list ;
+	int		kw_words ;
+	unsigned long	* keep_mask ;
+	unsigned long	* skip_mask ;
+} ;
+
+#define KW_BITS			( 8 * sizeof ( unsigned long ) )
+
+static void strnode_add( rcorder *, strnodelist **, const char *,
+  filenode * ) ;
+static int skip_ok( rcorder *, filenode * fnode ) ;
+static int keep_ok( rcorder *, filenode * fnode ) ;
+static void add_input( rcorder *, int, char *, const char *, int ) ;
+static void expand_dirs( rcorder * ) ;
+static void parse_input( rcorder *, rcinput * ) ;
+static void * parse_worker( void * ) ;
+static void parse_inputs( rcorder * ) ;
+static void merge_input( rcorder *, rcinput * ) ;
+static int count_provisions( rcorder * ) ;
+static char * scan_file( rcorder *, int, const char *, const char * ) ;
+static void hdr_add( hdrbuf *, int, const char *, size_t ) ;
+static char * scan_header( rcorder *, const char *, size_t, int ) ;
+static void apply_header( rcorder *, filenode *, const char * ) ;
+static void cache_load( rcorder * ) ;
+static void cache_save( rcorder * ) ;
+static void parse_line( rcorder *, filenode *, char *,
+  void (*)( rcorder *, filenode *, char * ) ) ;
+static filenode * filenode_new( rcorder *, char * ) ;
+static void add_require( rcorder *, filenode *, char * ) ;
+static void add_provide( rcorder *, filenode *, char * ) ;
+static void add_before( rcorder *, filenode *, char * ) ;
+static void add_keyword( rcorder *, filenode *, char * ) ;
+static void insert_before( rcorder * ) ;
+static void crunch_all_files( rcorder * ) ;
+static void initialize( rcorder * ) ;
+static void kw_intern( rcorder * ) ;
+static unsigned long * kw_set_new( rcorder * ) ;
+static int kw_any( rcorder *, const unsigned long *, const unsigned long * ) ;
+static void link_files( rcorder * ) ;
+static void break_cycles( rcorder * ) ;
+static void release_file( filenode *, filenode **, int * ) ;
+static int order_files( rcorder *, filenode ** ) ;
+static void reset_files( rcorder * ) ;
+static int order_kept( rcorder *, const char *, rcorder_file ** ) ;
+static double now_secs( void ) ;
+static void * aalloc( rcorder *, size_t ) ;
+static char * astrdup( rcorder *, const char * ) ;
+static void arena_free( rcorder * ) ;
+static void release_all( rcorder * ) ;
+
+#ifdef __linux__
+static char * estrdup ( const char * str )
+{
+  char * res ;
+
+  if ( ! str ) { return NULL ; }
+
+  res = strdup ( str ) ;
+
+  if ( res ) { return res ; }
+
+  fputs ( "out of memory\n", stderr ) ;
+  exit ( -1 ) ;
+
+  return NULL ;
+}
+#endif
+
+
+/*
+ * the graph (file, provision, requirement and dependant nodes, file
+ * names and word lists) lives in an arena: a short list of big blocks
+ * handed out by bumping a pointer.  nodes are never freed one by one,
+ * the whole graph goes away with arena_free().
+ */
+static void *
+aalloc ( rcorder * rc, size_t size )
+{
+  void * res ;
+  const size_t align = sizeof ( rc -> arena -> data [ 0 ] ) ;
+
+  size = ( size + align - 1 ) / align * align ;
+
+  if ( NULL == rc -> arena
+    || rc -> arena -> size - rc -> arena -> used < size )
+  {
+    size_t bsize = rc -> arena ? 2 * rc -> arena -> size : ARENA_MIN ;
+    arenablk * blk ;
+
+    if ( ARENA_MAX < bsize ) { bsize = ARENA_MAX ; }
+    if ( bsize < size ) { bsize = size ; }
+
+    blk = emalloc ( offsetof ( arenablk, data ) + bsize ) ;
+    blk -> next = rc -> arena ;
+    blk -> used = 0 ;
+    blk -> size = bsize ;
+    rc -> arena = blk ;
+  }
+
+  res = (char *) rc -> arena -> data + rc -> arena -> used ;
+  rc -> arena -> used += size ;
+
+  return res ;
+}
+
+static char *
+astrdup ( rcorder * rc, const char * str )
+{
+  const size_t len = strlen ( str ) + 1 ;
+
+  return memcpy ( aalloc ( rc, len ), str, len ) ;
+}
+
+static void
+arena_free ( rcorder * rc )
+{
+  arenablk * blk ;
+
+  while ( NULL != ( blk = rc -> arena ) ) {
+    rc -> arena = blk -> next ;
+    free ( blk ) ;
+  }
+}
+
+/* drop the graph, the tables and whatever else a context holds. */
+static void
+release_all ( rcorder * rc )
+{
+  Hash_Search search ;
+  Hash_Entry * entry ;
+  cachent * ce ;
+
+  if ( rc -> cache_hash ) {
+    for ( entry = Hash_EnumFirst ( rc -> cache_hash, & search ) ; entry ;
+      entry = Hash_EnumNext ( & search ) )
+    {
+      ce = Hash_GetValue ( entry ) ;
+      free ( ce -> hdr ) ;
+      free ( ce ) ;
+    }
+
+    Hash_DeleteTable ( rc -> cache_hash ) ;
+    rc -> cache_hash = NULL ;
+  }
+
+  if ( rc -> provide_hash ) { Hash_DeleteTable ( rc -> provide_hash ) ; }
+  if ( rc -> keyword_hash ) { Hash_DeleteTable ( rc -> keyword_hash ) ; }
+  arena_free ( rc ) ;
+  free ( rc -> inputs ) ;
+  while ( 0 < rc -> dir_count ) {
+    (void) close ( rc -> dir_fds [ -- rc -> dir_count ] ) ;
+  }
+  free ( rc -> dir_fds ) ;
+}
+
+/*
+ * below are the functions of the interface that set a context up
+ * and tear it down again.
+ */
+
+rcorder *
+rcorder_new ( void )
+{
+  rcorder * rc = emalloc ( sizeof ( * rc ) ) ;
+
+  memset ( rc, 0, sizeof ( * rc ) ) ;
+  rc -> threads = PARSE_THREADS ;
+  rc -> jobs = 1 ;
+  rc -> fn_head = rc -> fn_tail = & rc -> fn_head_s ;
+
+  return rc ;
+}
+
+void
+rcorder_free ( rcorder * rc )
+{
+  if ( NULL == rc ) { return ; }
+
+  release_all ( rc ) ;
+  free ( rc ) ;
+}
+
+/* header lines start with this prefix instead of "# " */
+void
+rcorder_comment ( rcorder * rc, const char * prefix )
+{
+  rc -> comment = prefix ? astrdup ( rc, prefix ) : NULL ;
+}
+
+/* keep the parsed header lines in this cache file */
+void
+rcorder_cache ( rcorder * rc, const char * file )
+{
+  rc -> cache_file = file ? astrdup ( rc, file ) : NULL ;
+}
+
+void
+rcorder_threads ( rcorder * rc, int n )
+{
+  if ( 1 > n ) { n = 1 ; }
+  if ( PARSE_THREADS_MAX < n ) { n = PARSE_THREADS_MAX ; }
+
+  rc -> threads = n ;
+}
+
+/* only files with this keyword (if any are given) */
+void
+rcorder_keep ( rcorder * rc, const char * keyword )
+{
+  if ( keyword && * keyword ) {
+    strnode_add ( rc, & rc -> keep_list, keyword, 0 ) ;
+  }
+}
+
+/* no files with this keyword */
+void
+rcorder_skip ( rcorder * rc, const char * keyword )
+{
+  if ( keyword && * keyword ) {
+    strnode_add ( rc, & rc -> skip_list, keyword, 0 ) ;
+  }
+}
+
+/* parse the files added, once. */
+int
+rcorder_load ( rcorder * rc )
+{
+  if ( rc -> loaded ) { return rc -> exit_code ; }
+
+  rc -> loaded = 1 ;
+  rc -> file_count = rc -> input_count ;
+  initialize ( rc ) ;
+  if ( rc -> cache_file ) { cache_load ( rc ) ; }
+  crunch_all_files ( rc ) ;
+  if ( rc -> cache_file ) { cache_save ( rc ) ; }
+
+  return rc -> exit_code ;
+}
+
+int
+rcorder_status ( const rcorder * rc )
+{
+  return rc -> exit_code ;
+}
+
+int
+rcorder_count ( const rcorder * rc )
+{
+  return rc -> node_count ;
+}
+
+void
+rcorder_times ( const rcorder * rc, double * parse, double * before )
+{
+  if ( parse ) { * parse = rc -> parse_secs ; }
+  if ( before ) { * before = rc -> before_secs ; }
+}
+
+/* initialise various variables. */
+static void
+initialize ( rcorder * rc )
+{
+  rc -> fn_head = rc -> fn_tail = & rc -> fn_head_s ;
+
+  rc -> provide_hash = & rc -> provide_hash_s ;
+  Hash_InitTable ( rc -> provide_hash, rc -> file_count ) ;
+
+  kw_intern ( rc ) ;
+}
+
+/* an empty keyword bitset */
+static unsigned long *
+kw_set_new ( rcorder * rc )
+{
+  unsigned long * bits = aalloc ( rc, rc -> kw_words * sizeof ( * bits ) ) ;
+
+  memset ( bits, 0, rc -> kw_words * sizeof ( * bits ) ) ;
+
+  return bits ;
+}
+
+/* number the keywords of the -k and -s lists and build their masks. */
+static void
+kw_intern ( rcorder * rc )
+{
+  int new = 0 ;
+  size_t id, count = 0 ;
+  strnodelist * s ;
+  Hash_Entry * entry ;
+
+  rc -> keyword_hash = & rc -> keyword_hash_s ;
+  Hash_InitTable ( rc -> keyword_hash, 0 ) ;
+
+  for ( s = rc -> keep_list ; s ; s = s -> next ) {
+    entry = Hash_CreateEntry ( rc -> keyword_hash, s -> s, & new ) ;
+    if ( new ) { Hash_SetValue ( entry, count ++ ) ; }
+  }
+
+  for ( s = rc -> skip_list ; s ; s = s -> next ) {
+    entry = Hash_CreateEntry ( rc -> keyword_hash, s -> s, & new ) ;
+    if ( new ) { Hash_SetValue ( entry, count ++ ) ; }
+  }
+
+  rc -> kw_words = ( count + KW_BITS - 1 ) / KW_BITS ;
+  rc -> keep_mask = kw_set_new ( rc ) ;
+  rc -> skip_mask = kw_set_new ( rc ) ;
+
+  for ( s = rc -> keep_list ; s ; s = s -> next ) {
+    id = (size_t)
+      Hash_GetValue ( Hash_FindEntry ( rc -> keyword_hash, s -> s ) ) ;
+    rc -> keep_mask [ id / KW_BITS ] |= 1UL << ( id % KW_BITS ) ;
+  }
+
+  for ( s = rc -> skip_list ; s ; s = s -> next ) {
+    id = (size_t)
+      Hash_GetValue ( Hash_FindEntry ( rc -> keyword_hash, s -> s ) ) ;
+    rc -> skip_mask [ id / KW_BITS ] |= 1UL << ( id % KW_BITS ) ;
+  }
+}
+
+/* generic function to insert a new strnodelist element */
+static void
+strnode_add ( rcorder * rc, strnodelist ** listp, const char * s,
+  filenode * fnode )
+{
+  strnodelist * ent ;
+
+  ent = aalloc ( rc, sizeof * ent + strlen( s ) ) ;
+  ent -> node = fnode ;
+  strcpy ( ent -> s, s ) ;
+  ent -> next = * listp ;
+  * listp = ent ;
+}
+
+/*
+ * below are the functions that deal with creating the lists
+ * from the filename's given and the dependancies and provisions
+ * in each of these files.  no ordering or checking is done here.
+ */
+
+/*
+ * we have a new filename, create a new filenode structure.
+ * fill in the bits, and put it in the filenode linked list
+ */
+static filenode *
+filenode_new ( rcorder * rc, char * filename )
+{
+  filenode * temp = aalloc ( rc, sizeof ( * temp ) ) ;
+
+  memset ( temp, 0, sizeof ( * temp ) ) ;
+  temp -> filename = astrdup ( rc, filename ) ;
+  temp -> req_list = NULL ;
+  temp -> prov_list = NULL ;
+  temp -> kw_bits = NULL ;
+  temp -> id = rc -> node_count ;
+  temp -> done = RESET ;
+  temp -> level = 0 ;
+  temp -> npending = 0 ;
+  temp -> pid = 0 ;
+  temp -> dep_list = NULL ;
+  temp -> bef_list = NULL ;
+  temp -> next = NULL ;
+  /* append, so the list keeps the command line order */
+  rc -> fn_tail -> next = temp ;
+  rc -> fn_tail = temp ;
+  ++ rc -> node_count ;
+
+  return temp ;
+}
+
+/* Adds a requirement to a filenode. */
+static void
+add_require ( rcorder * rc, filenode * fnode, char *s )
+{
+  int new = 0 ;
+  f_reqnode * rnode ;
+  Hash_Entry * entry = Hash_CreateEntry ( rc -> provide_hash, s, & new ) ;
+
+  if ( new ) { Hash_SetValue ( entry, NULL ) ; }
+  rnode = aalloc ( rc, sizeof (* rnode) ) ;
+  rnode -> entry = entry ;
+  rnode -> next = fnode -> req_list ;
+  fnode -> req_list = rnode ;
+}
+
+/*
+ * add a provision to a filenode.  if this provision doesn't
+ * have a head node, create one here.
+ */
+static void
+add_provide ( rcorder * rc, filenode * fnode, char *s )
+{
+  int new = 0 ;
+  Hash_Entry * entry ;
+  f_provnode * f_pnode ;
+  provnode * pnode, * head ;
+
+  entry = Hash_CreateEntry ( rc -> provide_hash, s, & new ) ;
+  head = Hash_GetValue ( entry ) ;
+
+	/* create a head node if necessary. */
+	if ( NULL == head ) {
+		head = aalloc ( rc, sizeof ( * head) ) ;
+		head -> head = SET ;
+		head -> fnode = NULL ;
+		head -> last = head -> next = NULL ;
+		Hash_SetValue ( entry, head ) ;
+	}
+#if 0
+	/*
+	 * Don't warn about this.  We want to be able to support
+	 * scripts that do two complex things:
+	 *
+	 *	- Two independent scripts which both provide the
+	 *	  same thing.  Both scripts must be executed in
+	 *	  any order to meet the barrier.  An example:
+	 *
+	 *		Script 1:
+	 *
+	 *			PROVIDE: mail
+	 *			REQUIRE: LOGIN
+	 *
+	 *		Script 2:
+	 *
+	 *			PROVIDE: mail
+	 *			REQUIRE: LOGIN
+	 *
+	 * 	- Two interdependent scripts which both provide the
+	 *	  same thing.  Both scripts must be executed in
+	 *	  graph order to meet the barrier.  An example:
+	 *
+	 *		Script 1:
+	 *
+	 *			PROVIDE: nameservice dnscache
+	 *			REQUIRE: SERVERS
+	 *
+	 *		Script 2:
+	 *
+	 *			PROVIDE: nameservice nscd
+	 *			REQUIRE: dnscache
+	 */
+	else if (new == 0) {
+		warnx("file `%s' provides `%s'.", fnode->filename, s);
+		warnx("\tpreviously seen in `%s'.",
+		    head->next->fnode->filename);
+	}
+#endif
+
+	pnode = aalloc ( rc, sizeof (* pnode ) ) ;
+	pnode -> head = RESET ;
+	pnode -> fnode = fnode ;
+	pnode -> next = head -> next ;
+	pnode -> last = head ;
+	head -> next = pnode ;
+	if ( NULL != pnode -> next ) {
+		pnode -> next -> last = pnode ;
+	}
+
+	f_pnode = aalloc ( rc, sizeof (* f_pnode) ) ;
+	f_pnode -> pnode = pnode ;
+	f_pnode -> next = fnode -> prov_list ;
+	fnode -> prov_list = f_pnode ;
+}
+
+/*
+ * put the BEFORE: lines to a list and handle them later.
+ */
+static void
+add_before ( rcorder * rc, filenode * fnode, char * s )
+{
+  strnode_add ( rc, & rc -> bl_list, s, fnode ) ;
+}
+
+/*
+ * add a key to a filenode.  only keys that -k or -s know about are
+ * of any interest, these get their bit set in the file's bitset.
+ */
+static void
+add_keyword ( rcorder * rc, filenode * fnode, char * s )
+{
+  size_t id ;
+  Hash_Entry * entry = Hash_FindEntry ( rc -> keyword_hash, s ) ;
+
+  if ( NULL == entry ) { return ; }
+
+  if ( NULL == fnode -> kw_bits ) { fnode -> kw_bits = kw_set_new ( rc ) ; }
+
+  id = (size_t) Hash_GetValue ( entry ) ;
+  fnode -> kw_bits [ id / KW_BITS ] |= 1UL << ( id % KW_BITS ) ;
+}
+
+/*
+ * loop over the rest of a line, giving each word to
+ * add_func() to do the real work.
+ */
+static void
+parse_line ( rcorder * rc, filenode * node, char * buffer,
+  void (* add_func) ( rcorder *, filenode *, char * ) )
+{
+  char * s2 = NULL ;
+  char * s = strtok_r ( buffer, " \t\n", & s2 ) ;
+
+  if ( s && * s ) {
+    (* add_func) ( rc, node, s ) ;
+  } else {
+    return ;
+  }
+
+  while ( NULL != ( s = strtok_r ( NULL, " \t\n", & s2 ) ) )
+  {
+    if ( s && * s ) { (* add_func) ( rc, node, s ) ; }
+  }
+}
+
+/*
+ * append one header line of the given kind ('R', 'P', 'B' or 'K')
+ * to a header record.  the record is a plain string of such lines,
+ * which is also the form the parse cache keeps them in.
+ */
+static void
+hdr_add ( hdrbuf * h, int kind, const char * s, size_t len )
+{
+  char * d ;
+
+  if ( h -> size < h -> len + len + 3 ) {
+    h -> size = 2 * h -> size + len + 64 ;
+    h -> s = realloc ( h -> s, h -> size ) ;
+    if ( NULL == h -> s ) {
+      perror ( "realloc failed" ) ;
+      exit ( -1 ) ;
+    }
+  }
+
+  h -> s [ h -> len ++ ] = kind ;
+  (void) memcpy ( h -> s + h -> len, s, len ) ;
+  /* a stray NUL would cut the record short */
+  for ( d = h -> s + h -> len ; d < h -> s + h -> len + len ; ++ d )
+    if ( '\0' == * d ) { * d = ' ' ; }
+  h -> len += len ;
+  h -> s [ h -> len ++ ] = '\n' ;
+  h -> s [ h -> len ] = '\0' ;
+}
+
+/*
+ * if the keyword at k (n bytes left on the line) is word, return the
+ * offset of the text following it, else 0.
+ */
+static size_t
+kw_is ( const char * k, size_t n, const char * word, size_t len )
+{
+  return ( len <= n && 0 == memcmp ( k, word, len ) ) ? len : 0 ;
+}
+
+/*
+ * scan the header block of a file's contents for provision and
+ * requirement lines and return them as a (malloced) header record
+ * (see hdr_add()).  the header block begins at the first header line
+ * and ends at the next line that is no header line, nothing after it
+ * is looked at.  lines are split with memchr() and the keyword is
+ * found with a single dispatch on its first letter.
+ * if partial is set, the contents are only the start of the file and
+ * NULL is returned when the header block may go on beyond them.
+ */
+static char *
+scan_header ( rcorder * rc, const char * p, size_t size, int partial )
+{
+  char parsing = 2 ;
+  const char * const end = p + size ;
+  const char * eol, * k ;
+  const char * prefix = COMMENT_STR ;
+  size_t plen = COMMENT_LEN, n, off ;
+  hdrbuf hb = { NULL, 0, 0 } ;
+  int kind ;
+
+  if ( rc -> comment && * rc -> comment ) {
+    prefix = rc -> comment ;
+    plen = strlen ( rc -> comment ) ;
+  }
+
+  for ( ; parsing && p < end ; p = eol + 1 ) {
+    eol = memchr ( p, '\n', end - p ) ;
+    if ( NULL == eol ) {
+      if ( partial ) { break ; }
+      eol = end ;
+    }
+
+    off = 0 ;
+    kind = 0 ;
+    n = eol - p ;
+
+    /* empty lines and lines starting with white space are no headers */
+    if ( plen < n && ' ' != * p && '\t' != * p
+      && 0 == memcmp ( p, prefix, plen ) )
+    {
+      k = p + plen ;
+      n -= plen ;
+
+      switch ( * k ) {
+        case 'R' :
+          kind = 'R' ;
+          if ( ! ( off = kw_is ( k, n, REQUIRE_STR, REQUIRE_LEN ) ) )
+            off = kw_is ( k, n, REQUIRES_STR, REQUIRES_LEN ) ;
+          break ;
+        case 'P' :
+          kind = 'P' ;
+          if ( ! ( off = kw_is ( k, n, PROVIDE_STR, PROVIDE_LEN ) ) )
+            off = kw_is ( k, n, PROVIDES_STR, PROVIDES_LEN ) ;
+          break ;
+        case 'B' :
+          kind = 'B' ;
+          off = kw_is ( k, n, BEFORE_STR, BEFORE_LEN ) ;
+          break ;
+        case 'K' :
+          kind = 'K' ;
+          if ( ! ( off = kw_is ( k, n, KEYWORD_STR, KEYWORD_LEN ) ) )
+            off = kw_is ( k, n, KEYWORDS_STR, KEYWORDS_LEN ) ;
+          break ;
+      }
+    }
+
+    if ( 0 == off ) {
+      /* the first non header line after the header block ends it */
+      if ( 1 == parsing ) { parsing = 0 ; }
+      continue ;
+    }
+
+    parsing = 1 ;
+    hdr_add ( & hb, kind, k + off, n - off ) ;
+  }
+
+  if ( partial && parsing ) {
+    free ( hb . s ) ;
+    return NULL ;
+  }
+
+  /* a file without any header lines still gets a record */
+  if ( NULL == hb . s ) { hdr_add ( & hb, 'K', "", 0 ) ; }
+
+  return hb . s ;
+}
+
+/*
+ * scan the header block of a file, returning the header record or
+ * NULL if the file could not be read.  the first HEAD_CHUNK bytes are
+ * simply read, that is cheaper than mapping small files.  only when
+ * the header block does not end within them the file gets mmap()ed.
+ */
+static char *
+scan_file ( rcorder * rc, const int dfd, const char * name,
+  const char * filename )
+{
+  struct stat st ;
+  char * hdr = NULL ;
+  void * map = NULL ;
+  char buf [ HEAD_CHUNK ] ;
+  ssize_t r = 0 ;
+  size_t got = 0 ;
+  const int fd = openat ( dfd, name, O_RDONLY | O_CLOEXEC ) ;
+
+  if ( 0 > fd ) {
+    warn ( "could not open %s for reading", filename ) ;
+    return NULL ;
+  }
+
+  while ( got < sizeof ( buf )
+    && 0 < ( r = read ( fd, buf + got, sizeof ( buf ) - got ) ) )
+  { got += r ; }
+
+  if ( 0 > r ) {
+    warn ( "could not read %s", filename ) ;
+  } else if ( got < sizeof ( buf ) ) {
+    hdr = scan_header ( rc, buf, got, 0 ) ;
+  } else if ( NULL != ( hdr = scan_header ( rc, buf, got, 1 ) ) ) {
+    ;
+  } else if ( fstat ( fd, & st ) ) {
+    warn ( "could not stat %s", filename ) ;
+  } else {
+    map = mmap ( NULL, st . st_size, PROT_READ, MAP_PRIVATE, fd, 0 ) ;
+
+    if ( MAP_FAILED == map ) {
+      warn ( "could not map %s", filename ) ;
+    } else {
+      hdr = scan_header ( rc, map, st . st_size, 0 ) ;
+      (void) munmap ( map, st . st_size ) ;
+    }
+  }
+
+  (void) close ( fd ) ;
+
+  return hdr ;
+}
+
+/*
+ * feed the lines of a header record to the add_*() functions.
+ */
+static void
+apply_header ( rcorder * rc, filenode * node, const char * hdr )
+{
+  char * buf = estrdup ( hdr ) ;
+  char * line = buf, * end = NULL ;
+
+  for ( ; * line ; line = end + 1 ) {
+    end = strchr ( line, '\n' ) ;
+    * end = '\0' ;
+
+    switch ( * line ) {
+      case 'R' : parse_line ( rc, node, line + 1, add_require ) ; break ;
+      case 'P' : parse_line ( rc, node, line + 1, add_provide ) ; break ;
+      case 'B' : parse_line ( rc, node, line + 1, add_before ) ; break ;
+      case 'K' : parse_line ( rc, node, line + 1, add_keyword ) ; break ;
+    }
+  }
+
+  free ( buf ) ;
+}
+
+/*
+ * below are the functions of the parse cache (-C).  it maps the path
+ * of every file seen to its stat identity (device, inode, size and
+ * modification time) and its header record, so files that did not
+ * change since the last run are not read and parsed again.
+ *
+ * the cache file is plain text:
+ *
+ *	rcorder-cache 1
+ *	C<comment prefix given to -c>
+ *	F <dev> <ino> <size> <mtime sec> <mtime nsec> <path>
+ *	<header record lines of that path>
+ *	F ...
+ */
+
+static int
+cache_same ( const cachent * ce, const struct stat * st )
+{
+  return ce -> dev == (unsigned long long) st -> st_dev
+    && ce -> ino == (unsigned long long) st -> st_ino
+    && ce -> size == (long long) st -> st_size
+    && ce -> sec == (long long) st -> st_mtime
+    && ce -> nsec == ST_MTIME_NSEC( st ) ;
+}
+
+static cachent *
+cache_enter ( rcorder * rc, char * path )
+{
+  int new = 0 ;
+  Hash_Entry * entry = Hash_CreateEntry ( rc -> cache_hash, path, & new ) ;
+  cachent * ce = Hash_GetValue ( entry ) ;
+
+  if ( NULL == ce ) {
+    ce = emalloc ( sizeof ( * ce ) ) ;
+    memset ( ce, 0, sizeof ( * ce ) ) ;
+    Hash_SetValue ( entry, ce ) ;
+  }
+
+  return ce ;
+}
+
+/* read the cache file, a missing or foreign one is just empty. */
+static void
+cache_load ( rcorder * rc )
+{
+  char * line = NULL ;
+  size_t size = 0 ;
+  ssize_t len ;
+  cachent * ce = NULL ;
+  hdrbuf hb = { NULL, 0, 0 } ;
+  FILE * fp ;
+
+  rc -> cache_hash = & rc -> cache_hash_s ;
+  Hash_InitTable ( rc -> cache_hash, rc -> file_count ) ;
+  /* anything but a clean load forces the cache to be rewritten */
+  rc -> cache_dirty = 1 ;
+
+  if ( NULL == ( fp = fopen ( rc -> cache_file, "r" ) ) ) { return ; }
+
+  if ( 0 > getline ( & line, & size, fp )
+    || strcmp ( line, CACHE_MAGIC "\n" )
+    || 0 > ( len = getline ( & line, & size, fp ) )
+    || 'C' != line [ 0 ]
+    || strncmp ( line + 1, rc -> comment ? rc -> comment : "", len - 2 )
+    || strlen ( rc -> comment ? rc -> comment : "" ) != (size_t) len - 2 )
+  {
+    free ( line ) ;
+    (void) fclose ( fp ) ;
+    return ;
+  }
+
+  while ( 0 < ( len = getline ( & line, & size, fp ) ) ) {
+    if ( '\n' == line [ len - 1 ] ) { line [ -- len ] = '\0' ; }
+
+    if ( 'F' == line [ 0 ] ) {
+      unsigned long long dev, ino ;
+      long long fsize, sec ;
+      long nsec ;
+      int off = 0 ;
+
+      if ( ce ) { ce -> hdr = hb . s ; }
+      ce = NULL ;
+      hb . s = NULL ;
+      hb . len = hb . size = 0 ;
+
+      if ( 5 > sscanf ( line, "F %llu %llu %lld %lld %ld %n",
+        & dev, & ino, & fsize, & sec, & nsec, & off ) || 0 == off
+        || '\0' == line [ off ] )
+      { continue ; }
+
+      ce = cache_enter ( rc, line + off ) ;
+      free ( ce -> hdr ) ;
+      ce -> dev = dev ;
+      ce -> ino = ino ;
+      ce -> size = fsize ;
+      ce -> sec = sec ;
+      ce -> nsec = nsec ;
+    } else if ( ce ) {
+      hdr_add ( & hb, line [ 0 ], line + 1, len - 1 ) ;
+    }
+  }
+
+  if ( ce ) { ce -> hdr = hb . s ; }
+  free ( line ) ;
+  (void) fclose ( fp ) ;
+  rc -> cache_dirty = 0 ;
+}
+
+/*
+ * write the cache back if anything changed.  only files seen in
+ * this run are kept, so removed scripts drop out of it.  the new
+ * cache replaces the old one atomically.
+ */
+static void
+cache_save ( rcorder * rc )
+{
+  Hash_Search search ;
+  Hash_Entry * entry ;
+  cachent * ce ;
+  FILE * fp ;
+  size_t len = strlen ( rc -> cache_file ) ;
+  char * tmp = emalloc ( len + 32 ) ;
+
+  for ( entry = Hash_EnumFirst ( rc -> cache_hash, & search ) ; entry ;
+    entry = Hash_EnumNext ( & search ) )
+  {
+    ce = Hash_GetValue ( entry ) ;
+    if ( NULL == ce -> hdr || ! ce -> used ) { rc -> cache_dirty = 1 ; }
+  }
+
+  if ( ! rc -> cache_dirty ) {
+    free ( tmp ) ;
+    return ;
+  }
+
+  (void) snprintf ( tmp, len + 32, "%s.%ld", rc -> cache_file,
+    (long) getpid () ) ;
+
+  if ( NULL == ( fp = fopen ( tmp, "w" ) ) ) {
+    warn ( "could not create %s", tmp ) ;
+    free ( tmp ) ;
+    return ;
+  }
+
+  fprintf ( fp, "%s\nC%s\n", CACHE_MAGIC, rc -> comment ? rc -> comment : "" ) ;
+
+  for ( entry = Hash_EnumFirst ( rc -> cache_hash, & search ) ; entry ;
+    entry = Hash_EnumNext ( & search ) )
+  {
+    ce = Hash_GetValue ( entry ) ;
+    if ( NULL == ce -> hdr || ! ce -> used
+      || strchr ( Hash_GetKey ( entry ), '\n' ) )
+    { continue ; }
+
+    fprintf ( fp, "F %llu %llu %lld %lld %ld %s\n%s",
+      ce -> dev, ce -> ino, ce -> size, ce -> sec, ce -> nsec,
+      Hash_GetKey ( entry ), ce -> hdr ) ;
+  }
+
+  if ( fclose ( fp ) || rename ( tmp, rc -> cache_file ) ) {
+    warn ( "could not write %s", rc -> cache_file ) ;
+    (void) unlink ( tmp ) ;
+  }
+
+  free ( tmp ) ;
+}
+
+/*
+ * below are the functions that gather the files to parse and parse
+ * them.  names come from the command line, from stdin (-0) and from
+ * the directories among those.  the parsing itself runs on up to
+ * threads threads, each taking the next file not yet claimed.  they
+ * only read the cache, the nodes and cache entries are made by the
+ * main thread afterwards, in command line order, so the output does
+ * not depend on which thread was faster.
+ */
+
+static void
+add_input ( rcorder * rc, const int dfd, char * path, const char * name,
+  const int top )
+{
+  rcinput * in ;
+
+  if ( NULL == path || '\0' == * path ) { return ; }
+
+  if ( rc -> input_count == rc -> input_size ) {
+    rc -> input_size = rc -> input_size ? 2 * rc -> input_size : 64 ;
+    in = realloc ( rc -> inputs, rc -> input_size * sizeof ( * in ) ) ;
+    if ( NULL == in ) { errx ( 1, "out of memory" ) ; }
+    rc -> inputs = in ;
+  }
+
+  in = & rc -> inputs [ rc -> input_count ++ ] ;
+  memset ( in, 0, sizeof ( * in ) ) ;
+  in -> path = path ;
+  in -> name = name ;
+  in -> dfd = dfd ;
+  in -> state = IN_NEW ;
+  in -> top = top ;
+}
+
+/* a file or directory to parse. */
+void
+rcorder_add ( rcorder * rc, const char * path )
+{
+  if ( path && * path ) {
+    char * p = astrdup ( rc, path ) ;
+
+    add_input ( rc, AT_FDCWD, p, p, 1 ) ;
+  }
+}
+
+/* more file (or directory) names, NUL separated. */
+void
+rcorder_add_list ( rcorder * rc, FILE * fp )
+{
+  char * line = NULL ;
+  size_t size = 0 ;
+
+  while ( 0 < getdelim ( & line, & size, '\0', fp ) ) {
+    rcorder_add ( rc, line ) ;
+  }
+
+  free ( line ) ;
+}
+
+static int
+input_cmp ( const void * a, const void * b )
+{
+  return strcmp ( ( (const rcinput *) a ) -> name,
+    ( (const rcinput *) b ) -> name ) ;
+}
+
+/* add a file found in the directory dir that has the descriptor dfd. */
+static void
+add_dir_entry ( rcorder * rc, const int dfd, const char * dir,
+  const char * name, const int type )
+{
+  const size_t dlen = strlen ( dir ) ;
+  const int slash = dlen && '/' != dir [ dlen - 1 ] ;
+  char * path ;
+
+  /* hidden files and subdirectories are no scripts */
+  if ( '.' == * name ) { return ; }
+#ifdef DT_DIR
+  if ( DT_DIR == type ) { return ; }
+#else
+  (void) type ;
+#endif
+
+  path = aalloc ( rc, dlen + slash + strlen ( name ) + 1 ) ;
+  memcpy ( path, dir, dlen ) ;
+  if ( slash ) { path [ dlen ] = '/' ; }
+  strcpy ( path + dlen + slash, name ) ;
+  add_input ( rc, dfd, path, path + dlen + slash, 0 ) ;
+}
+
+/* read the entries of a directory, directly with getdents64 on linux. */
+static void
+scan_dir ( rcorder * rc, const int dfd, const char * dir )
+{
+#ifdef __linux__
+  struct ldirent64 {
+    unsigned long long	d_ino ;
+    long long		d_off ;
+    unsigned short	d_reclen ;
+    unsigned char	d_type ;
+    char		d_name [ 1 ] ;
+  } * d ;
+  union {
+    char	b [ 32 * 1024 ] ;
+    long long	align ;
+  } buf ;
+  long n, off ;
+
+  while ( 0 < ( n = syscall ( SYS_getdents64, dfd, buf . b,
+    sizeof ( buf ) ) ) )
+  {
+    for ( off = 0 ; off < n ; off += d -> d_reclen ) {
+      d = (struct ldirent64 *) ( buf . b + off ) ;
+      add_dir_entry ( rc, dfd, dir, d -> d_name, d -> d_type ) ;
+    }
+  }
+
+  if ( 0 > n ) { warn ( "could not read directory %s", dir ) ; }
+#else
+  struct dirent * d ;
+  const int fd = dup ( dfd ) ;
+  DIR * dp = 0 > fd ? NULL : fdopendir ( fd ) ;
+
+  if ( NULL == dp ) {
+    warn ( "could not read directory %s", dir ) ;
+    if ( 0 <= fd ) { (void) close ( fd ) ; }
+    return ;
+  }
+
+  while ( NULL != ( d = readdir ( dp ) ) ) {
+#  ifdef DT_DIR
+    add_dir_entry ( rc, dfd, dir, d -> d_name, d -> d_type ) ;
+#  else
+    add_dir_entry ( rc, dfd, dir, d -> d_name, 0 ) ;
+#  endif
+  }
+
+  (void) closedir ( dp ) ;
+#endif
+}
+
+/*
+ * replace the directories among the inputs by the files in them,
+ * in name order.  the directories stay open, their files are opened
+ * relative to them.
+ */
+static void
+expand_dirs ( rcorder * rc )
+{
+  rcinput * old = rc -> inputs ;
+  const int n = rc -> input_count ;
+  int i, first, fd ;
+
+  rc -> inputs = NULL ;
+  rc -> input_count = rc -> input_size = 0 ;
+
+  for ( i = 0 ; i < n ; ++ i ) {
+    if ( IN_DIR != old [ i ] . state ) {
+      add_input ( rc, old [ i ] . dfd, old [ i ] . path, old [ i ] . name, 1 ) ;
+      rc -> inputs [ rc -> input_count - 1 ] = old [ i ] ;
+      continue ;
+    }
+
+    fd = openat ( old [ i ] . dfd, old [ i ] . name,
+      O_RDONLY | O_DIRECTORY | O_CLOEXEC ) ;
+
+    if ( 0 > fd ) {
+      warn ( "could not open directory %s", old [ i ] . path ) ;
+      continue ;
+    }
+
+    rc -> dir_fds = realloc ( rc -> dir_fds,
+      ( rc -> dir_count + 1 ) * sizeof ( int ) ) ;
+    if ( NULL == rc -> dir_fds ) { errx ( 1, "out of memory" ) ; }
+    rc -> dir_fds [ rc -> dir_count ++ ] = fd ;
+
+    first = rc -> input_count ;
+    scan_dir ( rc, fd, old [ i ] . path ) ;
+    qsort ( rc -> inputs + first, rc -> input_count - first,
+      sizeof ( * rc -> inputs ), input_cmp ) ;
+  }
+
+  free ( old ) ;
+}
+
+/*
+ * get the header record of one file, from the parse cache if the
+ * file did not change since it was cached, or else from reading it.
+ * this runs on the parse threads, so it must not touch the graph,
+ * the arena or the cache beyond looking things up.
+ */
+static void
+parse_input ( rcorder * rc, rcinput * in )
+{
+  Hash_Entry * entry ;
+  cachent * ce ;
+
+  if ( IN_NEW != in -> state ) { return ; }
+
+  in -> state = IN_BAD ;
+
+  if ( fstatat ( in -> dfd, in -> name, & in -> st, 0 ) ) {
+    warn ( "could not stat %s", in -> path ) ;
+    return ;
+  } else if ( in -> top && S_ISDIR( in -> st . st_mode ) ) {
+    in -> state = IN_DIR ;
+    return ;
+  } else if ( 0 == S_ISREG( in -> st . st_mode ) ) {
+    warn ( "%s is no regular file", in -> path ) ;
+    return ;
+  }
+
+  if ( rc -> cache_hash
+    && NULL != ( entry = Hash_FindEntry ( rc -> cache_hash, in -> path ) ) )
+  {
+    ce = Hash_GetValue ( entry ) ;
+
+    if ( ce -> hdr && cache_same ( ce, & in -> st ) ) {
+      in -> ce = ce ;
+      in -> hdr = ce -> hdr ;
+      in -> state = IN_OK ;
+      return ;
+    }
+  }
+
+  in -> hdr = scan_file ( rc, in -> dfd, in -> name, in -> path ) ;
+  if ( in -> hdr ) { in -> state = IN_OK ; }
+}
+
+static void *
+parse_worker ( void * arg )
+{
+  rcorder * rc = arg ;
+  int i ;
+
+  while ( rc -> input_count
+    > ( i = __sync_fetch_and_add ( & rc -> next_input, 1 ) ) )
+  { parse_input ( rc, & rc -> inputs [ i ] ) ; }
+
+  return NULL ;
+}
+
+/* parse the new inputs, on threads if there are enough of them. */
+static void
+parse_inputs ( rcorder * rc )
+{
+  pthread_t tid [ PARSE_THREADS_MAX ] ;
+  int i, n = rc -> input_count / PARSE_PER_THREAD ;
+
+  if ( rc -> threads < n ) { n = rc -> threads ; }
+
+  rc -> next_input = 0 ;
+
+  /* the main thread is one of them */
+  for ( i = 1 ; i < n ; ++ i ) {
+    if ( pthread_create ( & tid [ i ], NULL, parse_worker, rc ) ) {
+      break ;
+    }
+  }
+
+  n = i ;
+  (void) parse_worker ( rc ) ;
+
+  for ( i = 1 ; i < n ; ++ i ) { (void) pthread_join ( tid [ i ], NULL ) ; }
+}
+
+/*
+ * create the filenode of a parsed file, build the graphs from its
+ * header record and keep that in the cache.
+ */
+static void
+merge_input ( rcorder * rc, rcinput * in )
+{
+  cachent * ce = in -> ce ;
+
+  if ( IN_OK != in -> state ) { return ; }
+
+  apply_header ( rc, filenode_new ( rc, in -> path ), in -> hdr ) ;
+
+  if ( ce ) {
+    ce -> used = 1 ;
+  } else if ( rc -> cache_hash ) {
+    ce = cache_enter ( rc, in -> path ) ;
+    free ( ce -> hdr ) ;
+    ce -> hdr = in -> hdr ;
+    ce -> used = 1 ;
+    ce -> dev = in -> st . st_dev ;
+    ce -> ino = in -> st . st_ino ;
+    ce -> size = in -> st . st_size ;
+    ce -> sec = in -> st . st_mtime ;
+    ce -> nsec = ST_MTIME_NSEC( & in -> st ) ;
+    rc -> cache_dirty = 1 ;
+  } else {
+    free ( in -> hdr ) ;
+  }
+
+  in -> hdr = NULL ;
+}
+
+/*
+ * the number of words on the PROVIDE: lines of the files parsed, about
+ * the number of provisions.  provide_hash is sized for them before the
+ * files are merged, it was sized for the command line arguments only.
+ */
+static int
+count_provisions ( rcorder * rc )
+{
+  int i, n = 0 ;
+  const char * s ;
+
+  for ( i = 0 ; i < rc -> input_count ; ++ i ) {
+    if ( IN_OK != rc -> inputs [ i ] . state ) { continue ; }
+
+    for ( s = rc -> inputs [ i ] . hdr ; * s ; ++ s ) {
+      if ( 'P' != * s ) {
+        s = strchr ( s, '\n' ) ;
+        continue ;
+      }
+
+      for ( ++ s ; '\n' != * s ; ++ s ) {
+        if ( ' ' != * s && '\t' != * s && ( ' ' == s [ 1 ]
+          || '\t' == s [ 1 ] || '\n' == s [ 1 ] ) )
+        { ++ n ; }
+      }
+    }
+  }
+
+  return n ;
+}
+
+/*
+ * go through the BEFORE list, turning it into edges of the graph.  in
+ * the before list, for each entry B, we have a file F and a string S.
+ * every provider of S gets F put on its before list, link_files()
+ * then makes it wait for F just as for a provider of a requirement.
+ * no provisions or requirements are made up for this.
+ */
+static void
+insert_before ( rcorder * rc )
+{
+	Hash_Entry * entry ;
+	provnode * pnode ;
+	f_depnode * bnode ;
+	strnodelist * bl ;
+
+	for ( bl = rc -> bl_list ; bl ; bl = bl -> next ) {
+		entry = Hash_FindEntry ( rc -> provide_hash, bl -> s ) ;
+
+		if ( NULL == entry ) {
+			warnx ( "file `%s' is before unknown provision `%s'",
+			    bl -> node -> filename, bl -> s ) ;
+			continue ;
+		}
+
+		for ( pnode = Hash_GetValue ( entry ) ; pnode ; pnode = pnode -> next )
+		{
+			/* the head, and being before what we provide ourselves */
+			if ( pnode -> head || bl -> node == pnode -> fnode ) { continue ; }
+
+			bnode = aalloc ( rc, sizeof ( * bnode ) ) ;
+			bnode -> node = bl -> node ;
+			bnode -> next = pnode -> fnode -> bef_list ;
+			pnode -> fnode -> bef_list = bnode ;
+		}
+	}
+
+	/* the entries themselves stay in the arena */
+	rc -> bl_list = NULL ;
+}
+
+/*
+ * parse all the files, expanding the directories among them, then
+ * build their nodes in command line order.  after we have built all
+ * the nodes, insert the BEFORE: lines into graph(s).
+ */
+static void
+crunch_all_files ( rcorder * rc )
+{
+	int i;
+	double t = now_secs () ;
+
+	parse_inputs ( rc ) ;
+
+	for ( i = 0 ; i < rc -> input_count ; ++ i ) {
+		if ( IN_DIR == rc -> inputs [ i ] . state ) { break ; }
+	}
+
+	if ( i < rc -> input_count ) {
+		expand_dirs ( rc ) ;
+		parse_inputs ( rc ) ;
+	}
+
+	Hash_ReserveTable ( rc -> provide_hash, count_provisions ( rc ) ) ;
+
+	for ( i = 0 ; i < rc -> input_count ; ++ i )
+	{
+		merge_input ( rc, & rc -> inputs [ i ] ) ;
+	}
+
+	free ( rc -> inputs ) ;
+	rc -> inputs = NULL ;
+	rc -> input_count = rc -> input_size = 0 ;
+
+	while ( 0 < rc -> dir_count )
+		(void) close ( rc -> dir_fds [ -- rc -> dir_count ] ) ;
+	free ( rc -> dir_fds ) ;
+	rc -> dir_fds = NULL ;
+
+	rc -> parse_secs = now_secs () - t ;
+	t = now_secs () ;
+	insert_before ( rc ) ;
+	rc -> before_secs = now_secs () - t ;
+}
+
+/*
+ * below are the functions that traverse the graphs we have built
+ * finding out the desired ordering, printing each file in turn.
+ * if missing requirements, or cyclic graphs are detected, a
+ * warning will be issued, and we will continue on..
+ */
+
+/* do a file's keywords and a mask have a bit in common ? */
+static int
+kw_any ( rcorder * rc, const unsigned long * bits, const unsigned long * mask )
+{
+	int i ;
+
+	for ( i = 0 ; i < rc -> kw_words ; ++ i )
+		if ( bits [ i ] & mask [ i ] ) { return 1 ; }
+
+	return 0 ;
+}
+
+static int
+skip_ok ( rcorder * rc, filenode * fnode )
+{
+	return ! ( rc -> skip_list && fnode -> kw_bits
+	    && kw_any ( rc, fnode -> kw_bits, rc -> skip_mask ) ) ;
+}
+
+static int
+keep_ok ( rcorder * rc, filenode *fnode )
+{
+	/* an empty keep_list means every one */
+	if ( NULL == rc -> keep_list ) { return 1 ; }
+
+	return fnode -> kw_bits
+	    && kw_any ( rc, fnode -> kw_bits, rc -> keep_mask ) ;
+}
+
+/*
+ * turn the provision graph into file to file edges: for every
+ * requirement of a file, every provider of it gets the file put on
+ * its dependant list and the file counts one more pending provider.
+ * the same goes for every file on its before list.
+ * the provision lists are left intact.  cycles are broken right away.
+ * this is done once, each ordering starts over from the counts.
+ */
+static void
+link_files ( rcorder * rc )
+{
+	filenode * fnode, * before ;
+	f_reqnode * r ;
+	f_depnode * dnode ;
+	provnode * pnode ;
+
+	if ( rc -> linked ) { return ; }
+	rc -> linked = 1 ;
+
+	for ( fnode = rc -> fn_head -> next ; fnode ; fnode = fnode -> next ) {
+		/* the files before us: their before nodes become dep nodes */
+		while ( NULL != ( dnode = fnode -> bef_list ) ) {
+			fnode -> bef_list = dnode -> next ;
+			before = dnode -> node ;
+			dnode -> node = fnode ;
+			dnode -> next = before -> dep_list ;
+			before -> dep_list = dnode ;
+			++ fnode -> nprov ;
+		}
+
+		for ( r = fnode -> req_list ; r ; r = r -> next ) {
+			pnode = Hash_GetValue ( r -> entry ) ;
+
+			if ( NULL == pnode ) {
+				warnx ( "requirement `%s' in file `%s' has no providers.",
+				    Hash_GetKey ( r -> entry ), fnode -> filename ) ;
+				rc -> exit_code = 1 ;
+				continue ;
+			}
+
+			for ( pnode = pnode -> next ; pnode ; pnode = pnode -> next ) {
+				/* providing what we require is no dependency */
+				if ( fnode == pnode -> fnode ) { continue ; }
+
+				dnode = aalloc ( rc, sizeof ( * dnode ) ) ;
+				dnode -> node = fnode ;
+				dnode -> next = pnode -> fnode -> dep_list ;
+				pnode -> fnode -> dep_list = dnode ;
+				++ fnode -> nprov ;
+			}
+		}
+	}
+
+	break_cycles ( rc ) ;
+}
+
+static int
+id_cmp ( const void * a, const void * b )
+{
+	return ( * (filenode * const *) a ) -> id
+	    - ( * (filenode * const *) b ) -> id ;
+}
+
+/*
+ * report one cycle (a strongly connected component of more than one
+ * file) with all its files, and break it: of the edges inside it,
+ * those from a file to one given before it on the command line are
+ * dropped.  what is left only points forward, so the files of the
+ * cycle end up in command line order.
+ */
+static void
+break_cycle ( rcorder * rc, filenode ** member, const int n, const int * comp )
+{
+	filenode * fnode ;
+	f_depnode ** dp ;
+	char * msg, * p ;
+	size_t len = 1 ;
+	int i ;
+
+	qsort ( member, n, sizeof ( * member ), id_cmp ) ;
+
+	for ( i = 0 ; i < n ; ++ i )
+		len += strlen ( member [ i ] -> filename ) + 4 ;
+
+	p = msg = emalloc ( len ) ;
+	for ( i = 0 ; i < n ; ++ i )
+		p += sprintf ( p, "%s`%s'", i ? ", " : "", member [ i ] -> filename ) ;
+
+	warnx ( "Circular dependency among %s; run in that order.", msg ) ;
+	rc -> exit_code = 1 ;
+	free ( msg ) ;
+
+	for ( i = 0 ; i < n ; ++ i ) {
+		fnode = member [ i ] ;
+
+		for ( dp = & fnode -> dep_list ; * dp ; ) {
+			if ( comp [ ( * dp ) -> node -> id ] == comp [ fnode -> id ]
+			    && ( * dp ) -> node -> id < fnode -> id )
+			{
+				-- ( * dp ) -> node -> nprov ;
+				* dp = ( * dp ) -> next ;
+			} else {
+				dp = & ( * dp ) -> next ;
+			}
+		}
+	}
+}
+
+/*
+ * find the strongly connected components of the file graph (Tarjan's
+ * algorithm, with explicit stacks instead of recursion) and break
+ * those that are cycles, reporting each of them once.  this is
+ * linear in files plus edges, and afterwards the graph has no cycles
+ * left.  the components are reported in command line order of their
+ * first files.
+ */
+static void
+break_cycles ( rcorder * rc )
+{
+	const int n = rc -> node_count ;
+	filenode * fnode, * v, * w ;
+	filenode ** stack, ** call, ** out ;
+	f_depnode ** iter ;
+	int * index, * low, * comp, * start ;
+	int i, next = 0, sp = 0, cp = 0, nout = 0, ncomp = 0 ;
+
+	if ( 0 == n ) { return ; }
+
+	index = emalloc ( n * sizeof ( * index ) ) ;
+	low = emalloc ( n * sizeof ( * low ) ) ;
+	comp = emalloc ( n * sizeof ( * comp ) ) ;
+	start = emalloc ( ( n + 1 ) * sizeof ( * start ) ) ;
+	iter = emalloc ( n * sizeof ( * iter ) ) ;
+	stack = emalloc ( n * sizeof ( * stack ) ) ;
+	call = emalloc ( n * sizeof ( * call ) ) ;
+	out = emalloc ( n * sizeof ( * out ) ) ;
+
+	for ( i = 0 ; i < n ; ++ i ) { index [ i ] = comp [ i ] = -1 ; }
+
+	for ( fnode = rc -> fn_head -> next ; fnode ; fnode = fnode -> next ) {
+		if ( 0 <= index [ fnode -> id ] ) { continue ; }
+
+		index [ fnode -> id ] = low [ fnode -> id ] = next ++ ;
+		iter [ fnode -> id ] = fnode -> dep_list ;
+		stack [ sp ++ ] = call [ cp ++ ] = fnode ;
+
+		while ( 0 < cp ) {
+			v = call [ cp - 1 ] ;
+
+			if ( iter [ v -> id ] ) {
+				w = iter [ v -> id ] -> node ;
+				iter [ v -> id ] = iter [ v -> id ] -> next ;
+
+				if ( 0 > index [ w -> id ] ) {
+					index [ w -> id ] = low [ w -> id ] = next ++ ;
+					iter [ w -> id ] = w -> dep_list ;
+					stack [ sp ++ ] = call [ cp ++ ] = w ;
+					continue ;
+				}
+				/* still on the stack: in the component of v */
+				if ( 0 > comp [ w -> id ] && index [ w -> id ] < low [ v -> id ] )
+					low [ v -> id ] = index [ w -> id ] ;
+				continue ;
+			}
+
+			if ( 1 < cp && low [ v -> id ] < low [ call [ cp - 2 ] -> id ] )
+				low [ call [ cp - 2 ] -> id ] = low [ v -> id ] ;
+			-- cp ;
+
+			if ( low [ v -> id ] != index [ v -> id ] ) { continue ; }
+
+			/* v is the root of a component, pop it off the stack */
+			start [ ncomp ] = nout ;
+			do {
+				w = stack [ -- sp ] ;
+				comp [ w -> id ] = ncomp ;
+				out [ nout ++ ] = w ;
+			} while ( w != v ) ;
+			++ ncomp ;
+		}
+	}
+
+	start [ ncomp ] = nout ;
+
+	/* index is free again, it marks the components reported */
+	for ( i = 0 ; i < ncomp ; ++ i ) { index [ i ] = 0 ; }
+
+	for ( fnode = rc -> fn_head -> next ; fnode ; fnode = fnode -> next ) {
+		i = comp [ fnode -> id ] ;
+
+		if ( index [ i ] || 2 > start [ i + 1 ] - start [ i ] ) { continue ; }
+
+		index [ i ] = 1 ;
+		break_cycle ( rc, out + start [ i ], start [ i + 1 ] - start [ i ], comp ) ;
+	}
+
+	free ( out ) ;
+	free ( call ) ;
+	free ( stack ) ;
+	free ( iter ) ;
+	free ( start ) ;
+	free ( comp ) ;
+	free ( low ) ;
+	free ( index ) ;
+}
+
+/*
+ * a file is done: every file waiting for it has one pending provider
+ * less and is put on the ready queue when that was the last one.
+ */
+static void
+release_file ( filenode * fnode, filenode ** ready, int * nready )
+{
+	f_depnode * dnode ;
+
+	fnode -> done = SET ;
+
+	for ( dnode = fnode -> dep_list ; dnode ; dnode = dnode -> next ) {
+		/* we run no earlier than the last provider we waited for */
+		if ( dnode -> node -> level <= fnode -> level )
+			dnode -> node -> level = fnode -> level + 1 ;
+		if ( 0 == -- dnode -> node -> npending )
+			ready [ ( * nready ) ++ ] = dnode -> node ;
+	}
+}
+
+/* every file waits for all its providers again */
+static void
+reset_files ( rcorder * rc )
+{
+	filenode * fnode ;
+
+	for ( fnode = rc -> fn_head -> next ; fnode ; fnode = fnode -> next ) {
+		fnode -> npending = fnode -> nprov ;
+		fnode -> done = RESET ;
+		fnode -> level = 0 ;
+		fnode -> pid = 0 ;
+	}
+}
+
+/*
+ * put the files into the ready queue in a valid order (Kahn's
+ * algorithm): files without pending providers are queued in command
+ * line order, and every file done releases the files waiting for it.
+ * link_files() left no cycles, so every file gets queued.  this is
+ * linear in files plus edges and needs no recursion.  returns the
+ * number of files queued.
+ */
+static int
+order_files ( rcorder * rc, filenode ** ready )
+{
+	filenode * fnode ;
+	int first = 0, nready = 0 ;
+
+	reset_files ( rc ) ;
+
+	for ( fnode = rc -> fn_head -> next ; fnode ; fnode = fnode -> next )
+		if ( 0 == fnode -> npending ) { ready [ nready ++ ] = fnode ; }
+
+	while ( first < nready )
+		release_file ( ready [ first ++ ], ready, & nready ) ;
+
+	return nready ;
+}
+
+/*
+ * hand out the ordered files that pass -k/-s (and are marked, if
+ * mark is given) in queue order, with their levels.  every file of
+ * level N only requires files of levels < N, so all files of one
+ * level may be started concurrently once the previous level has
+ * completed.  levels left empty by the filters are squeezed out so
+ * the numbering stays dense.
+ */
+static int
+order_kept ( rcorder * rc, const char * mark, rcorder_file ** files )
+{
+	filenode ** order ;
+	rcorder_file * res ;
+	int * map ;
+	int i, n, k = 0, max = 0, lvl = 0 ;
+
+	order = emalloc ( ( rc -> node_count + 1 ) * sizeof ( * order ) ) ;
+	n = order_files ( rc, order ) ;
+
+	for ( i = 0 ; i < n ; ++ i )
+		if ( max < order [ i ] -> level ) { max = order [ i ] -> level ; }
+
+	map = emalloc ( ( max + 1 ) * sizeof ( * map ) ) ;
+	memset ( map, 0, ( max + 1 ) * sizeof ( * map ) ) ;
+	res = emalloc ( ( n + 1 ) * sizeof ( * res ) ) ;
+
+	for ( i = 0 ; i < n ; ++ i ) {
+		if ( ( mark && ! mark [ order [ i ] -> id ] )
+		    || ! skip_ok ( rc, order [ i ] ) || ! keep_ok ( rc, order [ i ] ) )
+			continue ;
+		map [ order [ i ] -> level ] = 1 ;
+		res [ k ] . file = order [ i ] -> filename ;
+		res [ k ++ ] . level = order [ i ] -> level ;
+	}
+
+	for ( i = 0 ; i <= max ; ++ i )
+		if ( map [ i ] ) { map [ i ] = lvl ++ ; }
+	for ( i = 0 ; i < k ; ++ i )
+		res [ i ] . level = map [ res [ i ] . level ] ;
+
+	free ( map ) ;
+	free ( order ) ;
+	* files = res ;
+
+	return k ;
+}
+
+int
+rcorder_order ( rcorder * rc, rcorder_file ** files )
+{
+	if ( ! rc -> loaded ) { (void) rcorder_load ( rc ) ; }
+
+	link_files ( rc ) ;
+
+	return order_kept ( rc, NULL, files ) ;
+}
+
+/* the same, sorted by level */
+int
+rcorder_levels ( rcorder * rc, rcorder_file ** files )
+{
+	rcorder_file * sorted ;
+	int * count ;
+	int i, max = 0, n = rcorder_order ( rc, files ) ;
+
+	for ( i = 0 ; i < n ; ++ i )
+		if ( max < ( * files ) [ i ] . level ) { max = ( * files ) [ i ] . level ; }
+
+	/* counting sort keeps the queue order within a level */
+	count = emalloc ( ( max + 2 ) * sizeof ( * count ) ) ;
+	memset ( count, 0, ( max + 2 ) * sizeof ( * count ) ) ;
+	sorted = emalloc ( ( n + 1 ) * sizeof ( * sorted ) ) ;
+
+	for ( i = 0 ; i < n ; ++ i )
+		++ count [ ( * files ) [ i ] . level + 1 ] ;
+	for ( i = 1 ; i <= max + 1 ; ++ i )
+		count [ i ] += count [ i - 1 ] ;
+	for ( i = 0 ; i < n ; ++ i )
+		sorted [ count [ ( * files ) [ i ] . level ] ++ ] = ( * files ) [ i ] ;
+
+	free ( count ) ;
+	free ( * files ) ;
+	* files = sorted ;
+
+	return n ;
+}
+
+/*
+ * below is the query for restarts.  given provisions or files, it
+ * finds every file depending on them, directly or not.  the files
+ * asked for (the providers of a provision) are part of the set.
+ */
+
+static void
+mark_file ( filenode * fnode, char * mark, filenode ** queue, int * nq )
+{
+	if ( mark [ fnode -> id ] ) { return ; }
+
+	mark [ fnode -> id ] = 1 ;
+	queue [ ( * nq ) ++ ] = fnode ;
+}
+
+int
+rcorder_closure ( rcorder * rc, char * const * names, const int nnames,
+  rcorder_file ** files )
+{
+	filenode ** queue, * fnode ;
+	f_depnode * dnode ;
+	provnode * pnode ;
+	Hash_Entry * entry ;
+	const char * base ;
+	char * mark ;
+	int i, n, nq = 0, found ;
+
+	if ( ! rc -> loaded ) { (void) rcorder_load ( rc ) ; }
+
+	link_files ( rc ) ;
+	mark = emalloc ( rc -> node_count + 1 ) ;
+	memset ( mark, 0, rc -> node_count + 1 ) ;
+	queue = emalloc ( ( rc -> node_count + 1 ) * sizeof ( * queue ) ) ;
+
+	for ( i = 0 ; i < nnames ; ++ i ) {
+		found = 0 ;
+		entry = Hash_FindEntry ( rc -> provide_hash, names [ i ] ) ;
+
+		if ( entry && NULL != ( pnode = Hash_GetValue ( entry ) ) ) {
+			for ( pnode = pnode -> next ; pnode ; pnode = pnode -> next ) {
+				mark_file ( pnode -> fnode, mark, queue, & nq ) ;
+				found = 1 ;
+			}
+		}
+
+		/* a file, by its name as given or its base name */
+		for ( fnode = rc -> fn_head -> next ; fnode ; fnode = fnode -> next ) {
+			base = strrchr ( fnode -> filename, '/' ) ;
+
+			if ( 0 == strcmp ( fnode -> filename, names [ i ] )
+			    || ( base && 0 == strcmp ( base + 1, names [ i ] ) ) )
+			{
+				mark_file ( fnode, mark, queue, & nq ) ;
+				found = 1 ;
+			}
+		}
+
+		if ( ! found ) {
+			warnx ( "`%s' is neither a provision nor a file.", names [ i ] ) ;
+			rc -> exit_code = 1 ;
+		}
+	}
+
+	/* the queue grows while we walk it, ending with the closure */
+	for ( i = 0 ; i < nq ; ++ i )
+		for ( dnode = queue [ i ] -> dep_list ; dnode ; dnode = dnode -> next )
+			mark_file ( dnode -> node, mark, queue, & nq ) ;
+
+	n = order_kept ( rc, mark, files ) ;
+
+	free ( queue ) ;
+	free ( mark ) ;
+
+	return n ;
+}
+
+/*
+ * below are the functions of the execution mode (-x).  instead of
+ * printing an ordering, the scripts are run directly: a file becomes
+ * runnable as soon as every file providing one of its requirements
+ * has exited, and at most `jobs' of them run at the same time.
+ */
+
+
+/* run one script with the argument given to -x. */
+static pid_t
+run_file ( rcorder * rc, filenode * fnode )
+{
+	pid_t pid ;
+
+	/* don't let the child flush our buffered output again */
+	(void) fflush ( NULL ) ;
+	pid = fork () ;
+
+	if ( 0 == pid ) {
+		(void) execl ( RC_SHELL, "sh", fnode -> filename, rc -> run_arg,
+		    (char *) NULL ) ;
+		warn ( "could not execute %s", RC_SHELL ) ;
+		_exit ( 127 ) ;
+	} else if ( 0 > pid ) {
+		warn ( "could not fork for %s", fnode -> filename ) ;
+	}
+
+	return pid ;
+}
+
+/*
+ * wait for one of the n running scripts to exit and reap it, but no
+ * other child of the caller's.  waitid() with WNOWAIT sleeps until
+ * some child exits without reaping it; if that one is not a script
+ * it is left to the caller and the scripts are polled every
+ * WAIT_POLL_MS until one of them exits.  returns the index of the
+ * script in running, or -1 on error.
+ */
+#define WAIT_POLL_MS		10
+
+static int
+wait_running ( filenode ** running, const int n, int * status )
+{
+	const struct timespec poll = { 0, WAIT_POLL_MS * 1000000L } ;
+	siginfo_t info ;
+	pid_t pid ;
+	int i ;
+
+	for ( ;; ) {
+		for ( i = 0 ; i < n ; ++ i ) {
+			pid = waitpid ( running [ i ] -> pid, status, WNOHANG ) ;
+			if ( pid == running [ i ] -> pid ) { return i ; }
+			if ( 0 > pid && EINTR != errno ) { return -1 ; }
+		}
+
+		(void) memset ( & info, 0, sizeof ( info ) ) ;
+		if ( 0 > waitid ( P_ALL, 0, & info, WEXITED | WNOWAIT ) ) {
+			if ( EINTR == errno ) { continue ; }
+			return -1 ;
+		}
+
+		for ( i = 0 ; i < n ; ++ i )
+			if ( running [ i ] -> pid == info . si_pid ) { break ; }
+		/* someone else's, don't spin on it */
+		if ( i == n ) { (void) nanosleep ( & poll, NULL ) ; }
+	}
+}
+
+/*
+ * the execution loop.  ready files are kept in a FIFO that is seeded
+ * in command line order, so the run is deterministic for -j 1.
+ * "file status seconds" is printed for every script run, where status
+ * is the exit code or 128 plus the number of the signal that killed
+ * it, and seconds is its run time (these lines can be given to -T).
+ */
+int
+rcorder_run ( rcorder * rc, const char * arg, const int jobs, FILE * out )
+{
+	filenode * fnode, ** ready, ** running ;
+	double * started, elapsed ;
+	int i, nready = 0, nrunning = 0, first = 0, status = 0 ;
+
+	if ( ! rc -> loaded ) { (void) rcorder_load ( rc ) ; }
+
+	rc -> run_arg = arg ;
+	rc -> jobs = 1 > jobs ? 1 : jobs ;
+	link_files ( rc ) ;
+	reset_files ( rc ) ;
+	ready = emalloc ( ( rc -> node_count + 1 ) * sizeof ( * ready ) ) ;
+	running = emalloc ( rc -> jobs * sizeof ( * running ) ) ;
+	started = emalloc ( rc -> jobs * sizeof ( * started ) ) ;
+
+	for ( fnode = rc -> fn_head -> next ; fnode ; fnode = fnode -> next )
+		if ( 0 == fnode -> npending ) { ready [ nready ++ ] = fnode ; }
+
+	while ( first < nready || 0 < nrunning ) {
+		while ( first < nready && nrunning < rc -> jobs ) {
+			fnode = ready [ first ++ ] ;
+
+			if ( skip_ok ( rc, fnode ) && keep_ok ( rc, fnode ) ) {
+				fnode -> pid = run_file ( rc, fnode ) ;
+				if ( 0 < fnode -> pid ) {
+					started [ nrunning ] = now_secs () ;
+					running [ nrunning ++ ] = fnode ;
+					continue ;
+				}
+				rc -> exit_code = 1 ;
+			}
+
+			/* filtered out or failed to start: done at once */
+			release_file ( fnode, ready, & nready ) ;
+		}
+
+		if ( 0 == nrunning ) { continue ; }
+
+		if ( 0 > ( i = wait_running ( running, nrunning, & status ) ) ) {
+			warn ( "waitpid" ) ;
+			rc -> exit_code = 1 ;
+			break ;
+		}
+
+		fnode = running [ i ] ;
+		elapsed = now_secs () - started [ i ] ;
+		-- nrunning ;
+		running [ i ] = running [ nrunning ] ;
+		started [ i ] = started [ nrunning ] ;
+
+		if ( WIFSIGNALED( status ) ) {
+			status = 128 + WTERMSIG( status ) ;
+		} else {
+			status = WEXITSTATUS( status ) ;
+		}
+		if ( status ) { rc -> exit_code = 1 ; }
+		fprintf ( out, "%s %d %.3f\n", fnode -> filename, status, elapsed ) ;
+		release_file ( fnode, ready, & nready ) ;
+	}
+
+	/* whatever still waits was cut off by a failed wait */
+	for ( fnode = rc -> fn_head -> next ; fnode ; fnode = fnode -> next )
+		if ( RESET == fnode -> done ) {
+			warnx ( "file `%s' not run.",
+			    fnode -> filename ) ;
+			rc -> exit_code = 1 ;
+		}
+
+	(void) fflush ( out ) ;
+	free ( started ) ;
+	free ( running ) ;
+	free ( ready ) ;
+
+	return rc -> exit_code ;
+}
+
+static double
+now_secs ( void )
+{
+	struct timespec ts ;
+
+	(void) clock_gettime ( CLOCK_MONOTONIC, & ts ) ;
+
+	return ts . tv_sec + ts . tv_nsec / 1e9 ;
+}
+
+/*
+ * below are the functions of the critical path report (-T file).
+ * the file holds the last measured run time of the scripts, one
+ * "name ... seconds" line per script: the first word is the script
+ * (its path or just its base name) and the last word its run time in
+ * seconds, anything in between is ignored.  so the output of -x can
+ * be used as it is.  scripts without a time count as instantaneous.
+ */
+
+/* read the timings into a table of script name -> seconds. */
+static void
+load_timings ( rcorder * rc, Hash_Table * t, const char * file )
+{
+  char * line = NULL, * name, * last, * end, * s2 ;
+  size_t size = 0 ;
+  double d, * secs ;
+  FILE * fp = fopen ( file, "r" ) ;
+
+  Hash_InitTable ( t, rc -> file_count ) ;
+
+  if ( NULL == fp ) {
+    warn ( "could not open %s for reading", file ) ;
+    rc -> exit_code = 1 ;
+    return ;
+  }
+
+  while ( 0 < getline ( & line, & size, fp ) ) {
+    if ( NULL == ( name = strtok_r ( line, " \t\n", & s2 ) )
+      || '#' == * name )
+    { continue ; }
+
+    for ( last = NULL ; NULL != ( end = strtok_r ( NULL, " \t\n", & s2 ) ) ; )
+      last = end ;
+    if ( NULL == last ) { continue ; }
+
+    d = strtod ( last, & end ) ;
+    /* not a timing line, e.g. some output of a script */
+    if ( '\0' != * end || 0 > d ) { continue ; }
+
+    secs = aalloc ( rc, sizeof ( * secs ) ) ;
+    * secs = d ;
+    Hash_SetValue ( Hash_CreateEntry ( t, name, NULL ), secs ) ;
+  }
+
+  free ( line ) ;
+  (void) fclose ( fp ) ;
+}
+
+static double
+file_secs ( Hash_Table * t, filenode * fnode )
+{
+  Hash_Entry * entry = Hash_FindEntry ( t, fnode -> filename ) ;
+  char * base = strrchr ( fnode -> filename, '/' ) ;
+
+  if ( NULL == entry && base ) { entry = Hash_FindEntry ( t, base + 1 ) ; }
+
+  return entry ? * (double *) Hash_GetValue ( entry ) : 0.0 ;
+}
+
+/* a script off the critical path, at index in the ordering */
+typedef struct slacknode {
+  double	slack ;
+  int		index ;
+  filenode	* fnode ;
+} slacknode ;
+
+/* by slack, ties in ordering order */
+static int
+slack_cmp ( const void * a, const void * b )
+{
+  const slacknode * const x = a, * const y = b ;
+
+  if ( x -> slack != y -> slack ) { return x -> slack < y -> slack ? -1 : 1 ; }
+
+  return x -> index - y -> index ;
+}
+
+/*
+ * compute the earliest start of every script (the latest finish of
+ * the scripts it waits for) in ordering order, and its latest finish
+ * that does not delay the whole run in reverse ordering order.  the
+ * critical path is followed back from the script finishing last,
+ * always to the provider that finished last.  all other scripts are
+ * listed with their slack: how much longer they could take without
+ * delaying anything.  output:
+ *
+ *	critical path <seconds>
+ *	<start> <duration> <file>	(one line per file on the path)
+ *	slack
+ *	<slack> <file>			(the others, least slack first)
+ */
+int
+rcorder_critical ( rcorder * rc, const char * file, FILE * out )
+{
+  Hash_Table timings ;
+  filenode ** order, ** crit, ** pred, * fnode ;
+  slacknode * rest ;
+  f_depnode * dnode ;
+  double * dur, * est, * lft, * slack, total = 0.0, t ;
+  int i, n, ncrit = 0, nslack = 0 ;
+  filenode * last = NULL ;
+
+  if ( ! rc -> loaded ) { (void) rcorder_load ( rc ) ; }
+
+  load_timings ( rc, & timings, file ) ;
+  link_files ( rc ) ;
+  order = emalloc ( ( rc -> node_count + 1 ) * sizeof ( * order ) ) ;
+  n = order_files ( rc, order ) ;
+
+  dur = emalloc ( ( rc -> node_count + 1 ) * sizeof ( * dur ) ) ;
+  est = emalloc ( ( rc -> node_count + 1 ) * sizeof ( * est ) ) ;
+  lft = emalloc ( ( rc -> node_count + 1 ) * sizeof ( * lft ) ) ;
+  slack = emalloc ( ( rc -> node_count + 1 ) * sizeof ( * slack ) ) ;
+  pred = emalloc ( ( rc -> node_count + 1 ) * sizeof ( * pred ) ) ;
+  crit = emalloc ( ( rc -> node_count + 1 ) * sizeof ( * crit ) ) ;
+  rest = emalloc ( ( rc -> node_count + 1 ) * sizeof ( * rest ) ) ;
+
+  for ( i = 0 ; i < n ; ++ i ) {
+    fnode = order [ i ] ;
+    dur [ fnode -> id ] = ( skip_ok ( rc, fnode ) && keep_ok ( rc, fnode ) )
+      ? file_secs ( & timings, fnode ) : 0.0 ;
+    est [ fnode -> id ] = 0.0 ;
+    slack [ fnode -> id ] = -1.0 ;
+    pred [ fnode -> id ] = NULL ;
+  }
+
+  /* forward pass: earliest starts */
+  for ( i = 0 ; i < n ; ++ i ) {
+    fnode = order [ i ] ;
+    t = est [ fnode -> id ] + dur [ fnode -> id ] ;
+
+    if ( NULL == last || total < t ) {
+      total = t ;
+      last = fnode ;
+    }
+
+    for ( dnode = fnode -> dep_list ; dnode ; dnode = dnode -> next )
+      if ( NULL == pred [ dnode -> node -> id ]
+        || est [ dnode -> node -> id ] < t )
+      {
+        est [ dnode -> node -> id ] = t ;
+        pred [ dnode -> node -> id ] = fnode ;
+      }
+  }
+
+  /* backward pass: latest finishes */
+  for ( i = n - 1 ; 0 <= i ; -- i ) {
+    fnode = order [ i ] ;
+    lft [ fnode -> id ] = total ;
+
+    for ( dnode = fnode -> dep_list ; dnode ; dnode = dnode -> next ) {
+      t = lft [ dnode -> node -> id ] - dur [ dnode -> node -> id ] ;
+      if ( t < lft [ fnode -> id ] ) { lft [ fnode -> id ] = t ; }
+    }
+  }
+
+  for ( fnode = last ; fnode ; fnode = pred [ fnode -> id ] ) {
+    crit [ ncrit ++ ] = fnode ;
+    /* on the path, not listed with the others */
+    slack [ fnode -> id ] = 0.0 ;
+  }
+
+  fprintf ( out, "critical path %.3f\n", total ) ;
+  while ( 0 < ncrit ) {
+    fnode = crit [ -- ncrit ] ;
+    fprintf ( out, "%.3f %.3f %s\n", est [ fnode -> id ], dur [ fnode -> id ],
+      fnode -> filename ) ;
+  }
+
+  /* the rest, by slack */
+  for ( i = 0 ; i < n ; ++ i ) {
+    fnode = order [ i ] ;
+    if ( 0.0 == slack [ fnode -> id ] || ! skip_ok ( rc, fnode )
+      || ! keep_ok ( rc, fnode ) )
+    { continue ; }
+
+    rest [ nslack ] . slack = lft [ fnode -> id ] - dur [ fnode -> id ]
+      - est [ fnode -> id ] ;
+    rest [ nslack ] . index = i ;
+    rest [ nslack ++ ] . fnode = fnode ;
+  }
+  qsort ( rest, nslack, sizeof ( * rest ), slack_cmp ) ;
+
+  fprintf ( out, "slack\n" ) ;
+  for ( i = 0 ; i < nslack ; ++ i )
+    fprintf ( out, "%.3f %s\n", rest [ i ] . slack,
+      rest [ i ] . fnode -> filename ) ;
+
+  Hash_DeleteTable ( & timings ) ;
+  free ( rest ) ;
+  free ( crit ) ;
+  free ( pred ) ;
+  free ( slack ) ;
+  free ( lft ) ;
+  free ( est ) ;
+  free ( dur ) ;
+  free ( order ) ;
+
+  return rc -> exit_code ;
+}
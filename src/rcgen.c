@@ -0,0 +1,105 @@
+/*
+ * generate a set of synthetic rc scripts for benchmarking rcorder.
+ *
+ * usage: rcgen [ -n files ] [ -i fanin ] [ -h hubs ] [ -b percent ]
+ *		[ -k percent ] [ -s seed ] dir
+ *
+ * script i provides "p<i>" and requires up to fanin provisions of
+ * scripts before it, mostly close ones (to get long chains) and with
+ * a 1 in 4 chance one of the first hubs scripts (to get a high fanout
+ * on those).  percent of the scripts get a BEFORE: line on a later
+ * script, and percent get KEYWORD:s out of a fixed set.  all edges
+ * point forward, so the graph has no cycles.  the same seed gives the
+ * same scripts.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char * const keywords [ ] = {
+  "nojail", "nostart", "firstboot", "shutdown", "resume", "suspend",
+} ;
+
+#define NKEYWORDS	( sizeof ( keywords ) / sizeof ( keywords [ 0 ] ) )
+
+static unsigned long int seed = 1 ;
+
+/* small LCG, so the output does not depend on the libc's rand() */
+static unsigned long int rnd ( const unsigned long int n )
+{
+  seed = seed * 6364136223846793005UL + 1442695040888963407UL ;
+
+  return n ? ( seed >> 33 ) % n : 0 ;
+}
+
+static void usage ( void )
+{
+  fputs ( "usage: rcgen [ -n files ] [ -i fanin ] [ -h hubs ]"
+    " [ -b percent ] [ -k percent ] [ -s seed ] dir\n", stderr ) ;
+  exit ( 100 ) ;
+}
+
+int main ( const int argc, char ** argv )
+{
+  int ch = -1 ;
+  unsigned long int i, j, n = 1000, fanin = 3, hubs = 8 ;
+  unsigned long int before = 10, keyed = 20 ;
+  char path [ 4096 ] = { 0 } ;
+  FILE * fp = NULL ;
+
+  while ( 0 <= ( ch = getopt ( argc, argv, "b:h:i:k:n:s:" ) ) ) {
+    switch ( ch ) {
+      case 'b' : before = strtoul ( optarg, NULL, 10 ) ; break ;
+      case 'h' : hubs = strtoul ( optarg, NULL, 10 ) ; break ;
+      case 'i' : fanin = strtoul ( optarg, NULL, 10 ) ; break ;
+      case 'k' : keyed = strtoul ( optarg, NULL, 10 ) ; break ;
+      case 'n' : n = strtoul ( optarg, NULL, 10 ) ; break ;
+      case 's' : seed = strtoul ( optarg, NULL, 10 ) ; break ;
+      default : usage () ; break ;
+    }
+  }
+
+  if ( optind + 1 != argc ) { usage () ; }
+
+  for ( i = 0 ; i < n ; ++ i ) {
+    (void) snprintf ( path, sizeof ( path ), "%s/r%07lu", argv [ optind ], i ) ;
+
+    if ( NULL == ( fp = fopen ( path, "w" ) ) ) {
+      perror ( path ) ;
+      return 111 ;
+    }
+
+    fprintf ( fp, "#!/bin/sh\n#\n# PROVIDE: p%lu\n", i ) ;
+
+    if ( 0 < i && 0 < fanin ) {
+      fputs ( "# REQUIRE:", fp ) ;
+      for ( j = 0 ; j < fanin ; ++ j ) {
+        const unsigned long int near = 1 + rnd ( i < 16 ? i : 16 ) ;
+        const unsigned long int req = ( 0 < hubs && 0 == rnd ( 4 ) )
+          ? rnd ( i < hubs ? i : hubs ) : i - near ;
+        fprintf ( fp, " p%lu", req ) ;
+      }
+      fputc ( '\n', fp ) ;
+    }
+
+    if ( i + 1 < n && rnd ( 100 ) < before ) {
+      fprintf ( fp, "# BEFORE: p%lu\n", i + 1 + rnd ( n - i - 1 ) ) ;
+    }
+
+    if ( rnd ( 100 ) < keyed ) {
+      fprintf ( fp, "# KEYWORD: %s %s\n", keywords [ rnd ( NKEYWORDS ) ],
+        keywords [ rnd ( NKEYWORDS ) ] ) ;
+    }
+
+    fputs ( "\n. /etc/rc.subr\n\nname=\"synthetic\"\nrun_rc_command \"$1\"\n", fp ) ;
+
+    if ( fclose ( fp ) ) {
+      perror ( path ) ;
+      return 111 ;
+    }
+  }
+
+  return 0 ;
+}
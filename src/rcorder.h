@@ -0,0 +1,78 @@
+/*
+ * librcorder: the parser and orderer of rcorder(8) as a library.
+ *
+ * all state lives in an rcorder context, so several of them can be
+ * used at the same time (but one context by one thread only).  set
+ * the options and add the files, then rcorder_load() parses them
+ * once.  after that the graph can be queried as often as needed.
+ *
+ *	rcorder * rc = rcorder_new () ;
+ *	rcorder_file * f ;
+ *	int i, n ;
+ *
+ *	rcorder_add ( rc, "/etc/rc.d" ) ;
+ *	rcorder_load ( rc ) ;
+ *	n = rcorder_order ( rc, & f ) ;
+ *	for ( i = 0 ; i < n ; ++ i ) puts ( f [ i ] . file ) ;
+ *	free ( f ) ;
+ *	rcorder_free ( rc ) ;
+ *
+ * problems (missing providers, cycles, unreadable files) are warned
+ * about on stderr and make rcorder_status() return 1, they are not
+ * fatal.  running out of memory is.
+ */
+
+#ifndef RCORDER_H
+#define RCORDER_H
+
+#include <stdio.h>
+
+typedef struct rcorder rcorder ;
+
+/* one file of an ordering, the name is valid until rcorder_free() */
+typedef struct rcorder_file {
+  const char	* file ;
+  int		level ;		/* files of one level may run together */
+} rcorder_file ;
+
+rcorder * rcorder_new ( void ) ;
+void rcorder_free ( rcorder * ) ;
+
+/* options, to be set before rcorder_load() */
+void rcorder_comment ( rcorder *, const char * ) ;
+void rcorder_cache ( rcorder *, const char * ) ;
+void rcorder_threads ( rcorder *, int ) ;
+void rcorder_keep ( rcorder *, const char * ) ;
+void rcorder_skip ( rcorder *, const char * ) ;
+
+/* files or directories to parse, before rcorder_load() too */
+void rcorder_add ( rcorder *, const char * ) ;
+void rcorder_add_list ( rcorder *, FILE * ) ;
+int rcorder_load ( rcorder * ) ;
+
+/*
+ * the queries.  the first three hand out an array of files (to be
+ * free()d) and return its length, files filtered out by keep/skip
+ * are left out.  rcorder_order() gives the files in a valid order,
+ * rcorder_levels() the same sorted by level and rcorder_closure()
+ * the files depending on the given provisions or files (and those
+ * themselves) in start order.  rcorder_run() runs the files with
+ * arg and rcorder_critical() reports the critical path for the run
+ * times in a file, both print their results to out.  rcorder_run()
+ * reaps only the scripts it started, but while it runs it sleeps on
+ * any child of the caller exiting, so children the caller does not
+ * reap meanwhile make it poll.
+ */
+int rcorder_order ( rcorder *, rcorder_file ** ) ;
+int rcorder_levels ( rcorder *, rcorder_file ** ) ;
+int rcorder_closure ( rcorder *, char * const *, int, rcorder_file ** ) ;
+int rcorder_run ( rcorder *, const char *, int, FILE * ) ;
+int rcorder_critical ( rcorder *, const char *, FILE * ) ;
+
+/* 0 if all went well so far, 1 if not */
+int rcorder_status ( const rcorder * ) ;
+/* files parsed, and the seconds parsing and the BEFORE: lines took */
+int rcorder_count ( const rcorder * ) ;
+void rcorder_times ( const rcorder *, double *, double * ) ;
+
+#endif
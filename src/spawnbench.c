@@ -0,0 +1,229 @@
+/*
+ * benchmark the ways stage2 can start a supervise process: fork () and
+ * a PATH search by execvp () in the child, as trystart () used to do,
+ * against posix_spawn () of a path resolved once beforehand.
+ *
+ * usage: spawnbench [ -m megabytes ] [ -p prog ] [ count ... ]
+ *
+ * for each count and way it reports the microseconds the parent spends
+ * per spawn call and per spawn all told (reaping included).  like in
+ * stage2 the child gets the end of a close-on-exec pipe as its stdin,
+ * an empty signal mask and the default disposition of the signals the
+ * parent catches.  -m first touches that much heap, to see what the
+ * size of the parent's address space does to fork ().  children are
+ * reaped BATCH at a time so a large count stays below the process
+ * limit.  prog defaults to "true", looked up in PATH.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BATCH		64
+
+extern char ** environ ;
+
+static const unsigned long int default_counts [ ] = { 100, 1000, 10000 } ;
+
+static const char * prog = "true" ;
+static char * path = NULL ;
+static sigset_t caught ;
+static posix_spawnattr_t attr ;
+static int pipefd [ 2 ] = { -1, -1 } ;
+
+static double now_us ( void )
+{
+  struct timespec ts ;
+
+  (void) clock_gettime ( CLOCK_MONOTONIC, & ts ) ;
+
+  return ts . tv_sec * 1e6 + ts . tv_nsec / 1e3 ;
+}
+
+static void die ( const char * what )
+{
+  perror ( what ) ;
+  exit ( 111 ) ;
+}
+
+/* the full path of prog, as stage2 resolves s6-supervise */
+static char * resolve ( const char * name )
+{
+  const char * p = getenv ( "PATH" ) ;
+  const size_t len = strlen ( name ) ;
+
+  if ( strchr ( name, '/' ) ) return strdup ( name ) ;
+  if ( NULL == p ) p = "/usr/bin:/bin" ;
+
+  while ( 1 ) {
+    const char * const end = strchr ( p, ':' ) ;
+    const size_t dlen = end ? (size_t) ( end - p ) : strlen ( p ) ;
+    char * const buf = malloc ( dlen + len + 2 ) ;
+
+    if ( NULL == buf ) die ( "malloc" ) ;
+    (void) memcpy ( buf, dlen ? p : ".", dlen ? dlen : 1 ) ;
+    buf [ dlen ? dlen : 1 ] = '/' ;
+    (void) memcpy ( buf + ( dlen ? dlen : 1 ) + 1, name, len + 1 ) ;
+    if ( 0 == access ( buf, X_OK ) ) return buf ;
+    free ( buf ) ;
+
+    if ( NULL == end ) return NULL ;
+    p = end + 1 ;
+  }
+}
+
+static pid_t spawn_fork ( void )
+{
+  const pid_t pid = fork () ;
+
+  if ( 0 == pid ) {
+    char * const argv [ 2 ] = { (char *) prog, NULL } ;
+    sigset_t none ;
+
+    (void) sigemptyset ( & none ) ;
+    (void) sigprocmask ( SIG_SETMASK, & none, NULL ) ;
+    (void) signal ( SIGCHLD, SIG_DFL ) ;
+    (void) signal ( SIGTERM, SIG_DFL ) ;
+    if ( 0 > dup2 ( pipefd [ 0 ], 0 ) ) _exit ( 111 ) ;
+    (void) execvp ( prog, argv ) ;
+    _exit ( 127 ) ;
+  }
+
+  return pid ;
+}
+
+static pid_t spawn_posix ( void )
+{
+  char * const argv [ 2 ] = { (char *) prog, NULL } ;
+  posix_spawn_file_actions_t fa ;
+  pid_t pid = 0 ;
+  int e = posix_spawn_file_actions_init ( & fa ) ;
+
+  if ( e ) { errno = e ; return -1 ; }
+  e = posix_spawn_file_actions_adddup2 ( & fa, pipefd [ 0 ], 0 ) ;
+  if ( ! e ) e = posix_spawn ( & pid, path, & fa, & attr, argv, environ ) ;
+  (void) posix_spawn_file_actions_destroy ( & fa ) ;
+
+  if ( e ) { errno = e ; return -1 ; }
+
+  return pid ;
+}
+
+static void reap_all ( unsigned long int k )
+{
+  int wstat = 0 ;
+
+  for ( ; k ; -- k ) {
+    if ( 0 > wait ( & wstat ) ) die ( "wait" ) ;
+    if ( ! WIFEXITED ( wstat ) || WEXITSTATUS ( wstat ) ) {
+      fprintf ( stderr, "spawnbench: %s failed\n", prog ) ;
+      exit ( 1 ) ;
+    }
+  }
+}
+
+static void bench ( const char * name, pid_t ( * spawn ) ( void ),
+  const unsigned long int count )
+{
+  unsigned long int i = 0, k = 0 ;
+  double t0, t1, calls = 0 ;
+
+  t0 = now_us () ;
+
+  for ( ; i < count ; ++ i ) {
+    t1 = now_us () ;
+    if ( 0 > spawn () ) die ( name ) ;
+    calls += now_us () - t1 ;
+
+    if ( BATCH == ++ k ) {
+      reap_all ( k ) ;
+      k = 0 ;
+    }
+  }
+
+  reap_all ( k ) ;
+
+  printf ( "%-12s %8lu %10.1f %10.1f\n", name, count, calls / count,
+    ( now_us () - t0 ) / count ) ;
+}
+
+int main ( int argc, char ** argv )
+{
+  unsigned long int mb = 0, n = 0 ;
+  sigset_t none ;
+  char * heap = NULL ;
+  int i ;
+
+  while ( 1 ) {
+    const int opt = getopt ( argc, argv, "m:p:" ) ;
+
+    if ( -1 == opt ) { break ; }
+
+    switch ( opt ) {
+      case 'm' : mb = strtoul ( optarg, NULL, 10 ) ; break ;
+      case 'p' : prog = optarg ; break ;
+      default :
+        fprintf ( stderr, "usage: spawnbench [ -m megabytes ] [ -p prog ] [ count ... ]\n" ) ;
+        return 100 ;
+    }
+  }
+
+  if ( NULL == ( path = resolve ( prog ) ) ) {
+    fprintf ( stderr, "spawnbench: %s not found in PATH\n", prog ) ;
+    return 111 ;
+  }
+
+  /* the pages fork () has to copy the tables of */
+  if ( mb ) {
+    if ( NULL == ( heap = malloc ( mb << 20 ) ) ) die ( "malloc" ) ;
+    (void) memset ( heap, 1, mb << 20 ) ;
+  }
+
+  if ( 0 > pipe ( pipefd ) ) die ( "pipe" ) ;
+  (void) fcntl ( pipefd [ 0 ], F_SETFD, FD_CLOEXEC ) ;
+  (void) fcntl ( pipefd [ 1 ], F_SETFD, FD_CLOEXEC ) ;
+
+  /* what stage2 blocks and catches */
+  (void) sigemptyset ( & caught ) ;
+  (void) sigaddset ( & caught, SIGCHLD ) ;
+  (void) sigaddset ( & caught, SIGTERM ) ;
+  (void) sigprocmask ( SIG_BLOCK, & caught, NULL ) ;
+
+  (void) sigemptyset ( & none ) ;
+  if ( posix_spawnattr_init ( & attr )
+    || posix_spawnattr_setsigmask ( & attr, & none )
+    || posix_spawnattr_setsigdefault ( & attr, & caught )
+    || posix_spawnattr_setflags ( & attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF ) )
+    die ( "posix_spawnattr" ) ;
+
+  printf ( "prog: %s, heap: %lu MB\n", path, mb ) ;
+  printf ( "%-12s %8s %10s %10s\n", "way", "count", "call us", "total us" ) ;
+
+  for ( i = optind ; i <= argc ; ++ i ) {
+    if ( i < argc ) {
+      if ( 0 == ( n = strtoul ( argv [ i ], NULL, 10 ) ) ) { continue ; }
+      bench ( "fork", spawn_fork, n ) ;
+      bench ( "posix_spawn", spawn_posix, n ) ;
+    } else if ( optind == argc ) {
+      unsigned int j = 0 ;
+
+      for ( ; j < sizeof ( default_counts ) / sizeof ( default_counts [ 0 ] ) ; ++ j ) {
+        bench ( "fork", spawn_fork, default_counts [ j ] ) ;
+        bench ( "posix_spawn", spawn_posix, default_counts [ j ] ) ;
+      }
+    }
+  }
+
+  free ( heap ) ;
+  free ( path ) ;
+
+  return 0 ;
+}
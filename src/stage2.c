@@ -3,6 +3,7 @@
  */
 
 #include "feat.h"
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
@@ -10,6 +11,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <spawn.h>
 #include <skalibs/allreadwrite.h>
 #include <skalibs/sgetopt.h>
 #include <skalibs/types.h>
@@ -29,17 +31,23 @@
 #  include <sys/prctl.h>
 #  include <linux/vt.h>
 #  include <linux/kd.h>
+#  include <sys/inotify.h>
+#  include <sys/epoll.h>
+#  include <sys/syscall.h>
 #endif
 
 #include "version.h"
 
 #define DIR_RETRY_TIMEOUT	3
 #define CHECK_RETRY_TIMEOUT	4
+#define FULL_SCAN_TIMEOUT	60
+#define NEW_DIR_TIMEOUT		1
+#define MIN_SERVICES		16
 #define FINISH_PROG		S6_SVSCAN_CTLDIR "/finish"
 #define CRASH_PROG		S6_SVSCAN_CTLDIR "/crash"
 #define SIGNAL_PROG		S6_SVSCAN_CTLDIR "/SIG"
 #define SIGNAL_PROG_LEN		(sizeof( SIGNAL_PROG ) - 1)
-#define USAGE			"s6-svscan [ -S | -s ] [ -c maxservices ] [ -t timeout ] [ -d notif ] [ dir ]"
+#define USAGE			"s6-svscan [ -S | -s ] [ -c services ] [ -t timeout ] [ -d notif ] [ dir ]"
 #define dieusage()		strerr_dieusage( 100, USAGE )
 
 /* integer constants */
@@ -55,9 +63,12 @@ emum {
 struct svinfo_s {
   dev_t dev ;
   ino_t ino ;
+  char * name ;			/* a name of it in the scan directory */
   tain_t restartafter [ 2 ] ;
   pid_t pid [ 2 ] ;
+  int pidfd [ 2 ] ;		/* -1 if not watched through a pidfd */
   int p [ 2 ] ;
+  unsigned int timer [ 2 ] ;	/* position in the timer heap + 1, or 0 */
   unsigned int flagactive : 1 ;
   unsigned int flaglog : 1 ;
 } ;
@@ -77,15 +88,69 @@ static int set_rlimits ( void )
   return setrlimit ( RLIMIT_CORE, & rlim ) ;
 }
 
-static size_t max = 500, n = 0 ;
+/*
+ * the pid index: which service slot (and which of its two supervise
+ * processes) a child belongs to, so reap() finds it without a search.
+ * open addressing with linear probing, at most half full since there
+ * are pidmask + 1 >= 4 * max entries for up to 2 * max pids.
+ */
+struct pident_s {
+  pid_t pid ;			/* 0 if the entry is free */
+  unsigned int who ;		/* slot * 2 + islog */
+} ;
+
+/*
+ * the directory index: the slot of the service with a given device and
+ * inode, so check() finds a service directory without a search.  the
+ * same kind of table, entries hold slot + 1 (0 if free) and the key is
+ * in the slot, there are dirmask + 1 >= 2 * max entries.
+ *
+ * the name index: likewise the slot of the service with a given name,
+ * so forget() finds the directory that went away without a search.  a
+ * name can be in two slots for a while, an old directory whose service
+ * is still going down and a new one made under the same name, the
+ * lookup skips inactive ones.  it is as big as the directory index.
+ */
+
+/*
+ * the new directories: names of directories made in the scan directory,
+ * each checked NEW_DIR_TIMEOUT after it appeared.  all wait as long, so
+ * a ring buffer in the order they came is due in order; it doubles when
+ * full and never shrinks.
+ */
+struct newdir_s {
+  char * name ;
+  tain_t due ;
+} ;
+
+/*
+ * the services table lives on the heap with room for max slots, n of
+ * them in use.  it doubles when full and halves when less than a
+ * quarter is used (down to MIN_SERVICES), the indexes are rebuilt at
+ * the new size.  -c only sets the size to start with.
+ */
+static size_t max = MIN_SERVICES, n = 0 ;
 static int wantreap = 1 ;
 static int wantscan = 1 ;
 static unsigned int wantkill = 0 ;
 static int cont = 1 ;
 static unsigned long int what = 0, got_sig = 0 ;
 static char const * finish_arg = "reboot" ;
-static tain_t deadline, defaulttimeout ;
+static tain_t deadline, defaulttimeout ;	/* of the next full scan */
 static struct svinfo_s * services ;
+static struct pident_s * pidtab ;
+static size_t pidmask = 0 ;
+static unsigned int * dirtab ;
+static size_t dirmask = 0 ;
+static unsigned int * nametab ;
+static int watchfd = -1 ;	/* inotify watch on the scan directory */
+static int epollfd = -1 ;	/* the pidfds of the supervise processes */
+static unsigned int * timers ;
+static size_t ntimers = 0, timersmax = 0 ;
+static struct newdir_s * newdirs ;
+static size_t newdirshead = 0, nnewdirs = 0, newdirsmax = 0 ;
+static char const * supervise = S6_BINPREFIX "s6-supervise" ;
+static posix_spawnattr_t spawnattr ;
 
 static void panicnosp ( const char * ) gccattr_noreturn ;
 
@@ -112,6 +177,332 @@ static void panic ( char const * errmsg )
   panicnosp ( errmsg ) ;
 }
 
+static size_t pid_hash ( const pid_t pid )
+{
+  return ( (unsigned int) pid * 2654435761U ) & pidmask ;
+}
+
+static struct pident_s * pid_find ( const pid_t pid )
+{
+  size_t j = pid_hash ( pid ) ;
+
+  for ( ; pidtab [ j ] . pid ; j = ( j + 1 ) & pidmask )
+    if ( pid == pidtab [ j ] . pid ) return pidtab + j ;
+
+  return NULL ;
+}
+
+static void pid_add ( const pid_t pid, const unsigned int i, const int islog )
+{
+  size_t j = pid_hash ( pid ) ;
+
+  while ( pidtab [ j ] . pid ) j = ( j + 1 ) & pidmask ;
+
+  pidtab [ j ] . pid = pid ;
+  pidtab [ j ] . who = 2 * i + ( islog ? 1 : 0 ) ;
+}
+
+/* remove pid from the index, returning its slot * 2 + islog or -1 */
+static int pid_take ( const pid_t pid )
+{
+  struct pident_s * const e = pid_find ( pid ) ;
+  size_t j, k ;
+  int who ;
+
+  if ( NULL == e ) return -1 ;
+
+  who = e -> who ;
+  j = e - pidtab ;
+
+  /* move the rest of the probe run up over the hole */
+  for ( k = ( j + 1 ) & pidmask ; pidtab [ k ] . pid ; k = ( k + 1 ) & pidmask ) {
+    const size_t h = pid_hash ( pidtab [ k ] . pid ) ;
+
+    /* entries whose home lies cyclically in ( j, k ] stay */
+    if ( ( j < k ) ? ( j < h && h <= k ) : ( j < h || h <= k ) ) continue ;
+
+    pidtab [ j ] = pidtab [ k ] ;
+    j = k ;
+  }
+
+  pidtab [ j ] . pid = 0 ;
+
+  return who ;
+}
+
+/* services [ i ] was just moved there, repoint its pids */
+static void pid_moved ( const unsigned int i )
+{
+  int k = 0 ;
+
+  for ( ; k < 2 ; ++ k ) {
+    if ( services [ i ] . pid [ k ] ) {
+      struct pident_s * const e = pid_find ( services [ i ] . pid [ k ] ) ;
+      if ( e ) e -> who = 2 * i + k ;
+    }
+  }
+}
+
+static size_t dir_hash ( const dev_t dev, const ino_t ino )
+{
+  const unsigned long long k = (unsigned long long) ino
+    ^ ( (unsigned long long) dev << 32 ) ^ ( (unsigned long long) dev >> 32 ) ;
+
+  return ( k * 0x9e3779b97f4a7c15ULL ) >> 32 & dirmask ;
+}
+
+/* the slot of the service with this directory, or n */
+static unsigned int dir_find ( const dev_t dev, const ino_t ino )
+{
+  size_t j = dir_hash ( dev, ino ) ;
+
+  for ( ; dirtab [ j ] ; j = ( j + 1 ) & dirmask ) {
+    const struct svinfo_s * const sv = services + dirtab [ j ] - 1 ;
+    if ( ino == sv -> ino && dev == sv -> dev ) return dirtab [ j ] - 1 ;
+  }
+
+  return n ;
+}
+
+static size_t dir_entry ( const unsigned int i )
+{
+  size_t j = dir_hash ( services [ i ] . dev, services [ i ] . ino ) ;
+
+  while ( dirtab [ j ] && i + 1 != dirtab [ j ] ) j = ( j + 1 ) & dirmask ;
+
+  return j ;
+}
+
+static void dir_add ( const unsigned int i )
+{
+  dirtab [ dir_entry ( i ) ] = i + 1 ;
+}
+
+static void dir_del ( const unsigned int i )
+{
+  size_t j = dir_entry ( i ), k ;
+
+  if ( ! dirtab [ j ] ) return ;
+
+  for ( k = ( j + 1 ) & dirmask ; dirtab [ k ] ; k = ( k + 1 ) & dirmask ) {
+    const struct svinfo_s * const sv = services + dirtab [ k ] - 1 ;
+    const size_t h = dir_hash ( sv -> dev, sv -> ino ) ;
+
+    if ( ( j < k ) ? ( j < h && h <= k ) : ( j < h || h <= k ) ) continue ;
+
+    dirtab [ j ] = dirtab [ k ] ;
+    j = k ;
+  }
+
+  dirtab [ j ] = 0 ;
+}
+
+static size_t name_hash ( const char * s )
+{
+  unsigned long long k = 0xcbf29ce484222325ULL ;
+
+  for ( ; * s ; ++ s ) k = ( k ^ (unsigned char) * s ) * 0x100000001b3ULL ;
+
+  return ( k ^ k >> 32 ) & dirmask ;
+}
+
+/* the slot of the active service with this name, or n */
+static unsigned int name_find ( const char * name )
+{
+  size_t j = name_hash ( name ) ;
+
+  for ( ; nametab [ j ] ; j = ( j + 1 ) & dirmask ) {
+    const struct svinfo_s * const sv = services + nametab [ j ] - 1 ;
+    if ( sv -> flagactive && 0 == strcmp ( name, sv -> name ) ) return nametab [ j ] - 1 ;
+  }
+
+  return n ;
+}
+
+static size_t name_entry ( const unsigned int i )
+{
+  size_t j = name_hash ( services [ i ] . name ) ;
+
+  while ( nametab [ j ] && i + 1 != nametab [ j ] ) j = ( j + 1 ) & dirmask ;
+
+  return j ;
+}
+
+static void name_add ( const unsigned int i )
+{
+  nametab [ name_entry ( i ) ] = i + 1 ;
+}
+
+static void name_del ( const unsigned int i )
+{
+  size_t j = name_entry ( i ), k ;
+
+  if ( ! nametab [ j ] ) return ;
+
+  for ( k = ( j + 1 ) & dirmask ; nametab [ k ] ; k = ( k + 1 ) & dirmask ) {
+    const size_t h = name_hash ( services [ nametab [ k ] - 1 ] . name ) ;
+
+    if ( ( j < k ) ? ( j < h && h <= k ) : ( j < h || h <= k ) ) continue ;
+
+    nametab [ j ] = nametab [ k ] ;
+    j = k ;
+  }
+
+  nametab [ j ] = 0 ;
+}
+
+/*
+ * the restart timers: a binary min-heap of slot * 2 + islog, keyed on
+ * restartafter [ islog ], with room for 2 * max of them.  the loop
+ * wakes when the first one is due and restarts just that service, a
+ * crash looping one costs no full scan.
+ */
+#define TIMER_AT( w )	( & services [ ( w ) >> 1 ] . restartafter [ ( w ) & 1 ] )
+
+static void timer_put ( const size_t j, const unsigned int w )
+{
+  timers [ j ] = w ;
+  services [ w >> 1 ] . timer [ w & 1 ] = j + 1 ;
+}
+
+/* move the timer at j up or down to its place */
+static void timer_sift ( size_t j )
+{
+  const unsigned int w = timers [ j ] ;
+
+  while ( j && tain_less ( TIMER_AT ( w ), TIMER_AT ( timers [ ( j - 1 ) / 2 ] ) ) ) {
+    timer_put ( j, timers [ ( j - 1 ) / 2 ] ) ;
+    j = ( j - 1 ) / 2 ;
+  }
+
+  while ( 2 * j + 1 < ntimers ) {
+    size_t c = 2 * j + 1 ;
+
+    if ( c + 1 < ntimers && tain_less ( TIMER_AT ( timers [ c + 1 ] ), TIMER_AT ( timers [ c ] ) ) ) ++ c ;
+    if ( ! tain_less ( TIMER_AT ( timers [ c ] ), TIMER_AT ( w ) ) ) break ;
+
+    timer_put ( j, timers [ c ] ) ;
+    j = c ;
+  }
+
+  timer_put ( j, w ) ;
+}
+
+/* (re)arm the timer of supervise process islog of slot i */
+static void timer_set ( const unsigned int i, const int islog )
+{
+  const size_t j = services [ i ] . timer [ islog ] ;
+
+  if ( j ) timer_sift ( j - 1 ) ;
+  else {
+    timers [ ntimers ] = 2 * i + islog ;
+    timer_sift ( ntimers ++ ) ;
+  }
+}
+
+static void timer_del ( const unsigned int w )
+{
+  const size_t j = services [ w >> 1 ] . timer [ w & 1 ] ;
+
+  if ( ! j ) return ;
+
+  services [ w >> 1 ] . timer [ w & 1 ] = 0 ;
+
+  if ( j < ntimers -- ) {
+    timer_put ( j - 1, timers [ ntimers ] ) ;
+    timer_sift ( j - 1 ) ;
+  }
+}
+
+/* give the services table room for cap slots, 0 if out of memory */
+static int resize_services ( const size_t cap )
+{
+  struct svinfo_s * s = NULL ;
+  struct pident_s * pt = NULL ;
+  unsigned int * dt = NULL, * nt = NULL ;
+  size_t pm = 1, i = 0 ;
+
+  for ( ; pm < 4 * cap ; pm <<= 1 ) ;
+
+  pt = calloc ( pm, sizeof ( * pt ) ) ;
+  dt = calloc ( pm >> 1, sizeof ( * dt ) ) ;
+  nt = calloc ( pm >> 1, sizeof ( * nt ) ) ;
+
+  /*
+   * room for the 2 * max timers there can be, grown first and never
+   * shrunk, so it stays big enough whatever fails after.
+   */
+  if ( pt && dt && nt && timersmax < 2 * cap ) {
+    unsigned int * const tm = realloc ( timers, 2 * cap * sizeof ( * tm ) ) ;
+
+    if ( tm ) {
+      timers = tm ;
+      timersmax = 2 * cap ;
+    }
+  }
+
+  if ( pt && dt && nt && timersmax >= 2 * cap ) s = realloc ( services, cap * sizeof ( * s ) ) ;
+
+  if ( NULL == s ) {
+    free ( pt ) ;
+    free ( dt ) ;
+    free ( nt ) ;
+    return 0 ;
+  }
+
+  free ( pidtab ) ;
+  free ( dirtab ) ;
+  free ( nametab ) ;
+  services = s ;
+  max = cap ;
+  pidtab = pt ;
+  pidmask = pm - 1 ;
+  dirtab = dt ;
+  dirmask = ( pm >> 1 ) - 1 ;
+  nametab = nt ;
+
+  for ( ; i < n ; ++ i ) {
+    dir_add ( i ) ;
+    name_add ( i ) ;
+    if ( services [ i ] . pid [ 0 ] ) pid_add ( services [ i ] . pid [ 0 ], i, 0 ) ;
+    if ( services [ i ] . pid [ 1 ] ) pid_add ( services [ i ] . pid [ 1 ], i, 1 ) ;
+  }
+
+  return 1 ;
+}
+
+/*
+ * forget the service in slot i, which has no supervise processes
+ * left, and move the last one into its place.
+ */
+static void drop_service ( const unsigned int i )
+{
+  dir_del ( i ) ;
+  name_del ( i ) ;
+  timer_del ( 2 * i ) ;
+  timer_del ( 2 * i + 1 ) ;
+  free ( services [ i ] . name ) ;
+
+  if ( i + 1 < n ) {
+    const unsigned int last = n - 1 ;
+    const size_t j = dir_entry ( last ), l = name_entry ( last ) ;
+    int k = 0 ;
+
+    services [ i ] = services [ last ] ;
+    if ( dirtab [ j ] ) dirtab [ j ] = i + 1 ;
+    if ( nametab [ l ] ) nametab [ l ] = i + 1 ;
+    pid_moved ( i ) ;
+
+    for ( ; k < 2 ; ++ k )
+      if ( services [ i ] . timer [ k ] ) timers [ services [ i ] . timer [ k ] - 1 ] = 2 * i + k ;
+  }
+
+  -- n ;
+
+  /* a failure to shrink does no harm */
+  if ( 2 * MIN_SERVICES <= max && n < max / 4 ) (void) resize_services ( max / 2 ) ;
+}
+
 static void killthem ( void )
 {
   unsigned int i = 0 ;
@@ -243,10 +634,56 @@ static void handle_control ( const int fd )
   }
 }
 
+/* supervise process who (slot * 2 + islog) is gone and reaped */
+static void exited ( const int who, tain_t const * nextscan )
+{
+  const unsigned int i = who >> 1 ;
+
+  if ( 0 <= services [ i ] . pidfd [ who & 1 ] ) {
+    fd_close ( services [ i ] . pidfd [ who & 1 ] ) ;
+    services [ i ] . pidfd [ who & 1 ] = -1 ;
+  }
+
+  services [ i ] . pid [ who & 1 ] = 0 ;
+  services [ i ] . restartafter [ who & 1 ] = * nextscan ;
+
+  if ( services [ i ] . flagactive ) {
+    timer_set ( i, who & 1 ) ;
+  } else {
+    if ( services [ i ] . flaglog ) {
+ /*
+    BLACK MAGIC:
+     - we need to close the pipe early:
+       * as soon as the writer exits so the logger can exit on EOF
+       * or as soon as the logger exits so the writer can crash on EPIPE
+     - but if the same service gets reactivated before the second
+       supervise process exits, ouch: we've lost the pipe
+     - so we can't reuse the same service even if it gets reactivated
+     - so we're marking a dying service with a closed pipe
+     - if the scanner sees a service with p[0] = -1 it won't flag
+       it as active (and won't restart the dead supervise)
+     - but if the service gets reactivated we want it to restart
+       as soon as the 2nd supervise process dies
+     - so the scanner marks such a process with p[0] = -2
+     - and the reaper triggers a scan when it finds a -2.
+ */
+      if (services[i].p[0] >= 0) {
+        fd_close(services[i].p[1]) ; services[i].p[1] = -1 ;
+        fd_close(services[i].p[0]) ; services[i].p[0] = -1 ;
+      } else if (services[i].p[0] == -2) wantscan = 1 ;
+    }
+
+    if (!services[i].pid[0] && (!services[i].flaglog || !services[i].pid[1]))
+      drop_service ( i ) ;
+  }
+}
+
 /* First essential function: the reaper.
  * s6-svscan must wait() for all children,
  * including ones it doesn't know it has.
  * Dead active services are flagged to be restarted in 1 second.
+ * With pidfds the supervise processes are mostly reaped by
+ * handle_pidfds() already, this sweep gets the orphans.
  */
 static void reap ( void )
 {
@@ -266,82 +703,201 @@ static void reap ( void )
       else break ;
     else if ( ! r ) break ;
     else {
-      unsigned int i = 0 ;
+      const int who = pid_take ( r ) ;
 
-      for ( i = 0 ; i < n ; ++ i ) {
-        if ( services [ i ] . pid [ 0 ] == r ) {
-          services [ i ] . pid [ 0 ] = 0 ;
-          services [ i ] . restartafter [ 0 ] = nextscan ;
-          break ;
-        } else if ( services [ i ] . pid [ 1 ] == r ) {
-          services [ i ] . pid [ 1 ] = 0 ;
-          services [ i ] . restartafter [ 1 ] = nextscan ;
-          break ;
-        }
-      }
+      /* not a supervisor of ours */
+      if ( who < 0 ) continue ;
 
-      if ( i == n ) continue ;
+      exited ( who, & nextscan ) ;
+    }
+  }
+}
 
-      if ( services [ i ] . flagactive ) {
-        if (tain_less(&nextscan, &deadline)) deadline = nextscan ;
-      } else {
-        if ( services [ i ] . flaglog ) {
- /*
-    BLACK MAGIC:
-     - we need to close the pipe early:
-       * as soon as the writer exits so the logger can exit on EOF
-       * or as soon as the logger exits so the writer can crash on EPIPE
-     - but if the same service gets reactivated before the second
-       supervise process exits, ouch: we've lost the pipe
-     - so we can't reuse the same service even if it gets reactivated
-     - so we're marking a dying service with a closed pipe
-     - if the scanner sees a service with p[0] = -1 it won't flag
-       it as active (and won't restart the dead supervise)
-     - but if the service gets reactivated we want it to restart
-       as soon as the 2nd supervise process dies
-     - so the scanner marks such a process with p[0] = -2
-     - and the reaper triggers a scan when it finds a -2.
+#if defined (OSLinux) && defined (SYS_pidfd_open)
+
+static int open_pidfd ( const pid_t pid )
+{
+  return syscall ( SYS_pidfd_open, pid, 0 ) ;
+}
+
+/* use pidfds if the kernel has them (5.3 and later) */
+static void pidfd_setup ( void )
+{
+  int fd = -1 ;
+
+  epollfd = epoll_create1 ( EPOLL_CLOEXEC ) ;
+  if ( 0 > epollfd ) return ;
+
+  fd = open_pidfd ( getpid () ) ;
+
+  if ( 0 > fd ) {
+    fd_close ( epollfd ) ;
+    epollfd = -1 ;
+  } else fd_close ( fd ) ;
+}
+
+/*
+ * watch supervise process islog of slot i through a pidfd.  without
+ * one (out of fds, say) the SIGCHLD sweep reaps it as before.
  */
-          if (services[i].p[0] >= 0) {
-            fd_close(services[i].p[1]) ; services[i].p[1] = -1 ;
-            fd_close(services[i].p[0]) ; services[i].p[0] = -1 ;
-          } else if (services[i].p[0] == -2) wantscan = 1 ;
-        }
+static void pidfd_add ( const unsigned int i, const int islog )
+{
+  struct epoll_event ev ;
+  int fd = -1 ;
+
+  if ( 0 > epollfd ) return ;
+
+  fd = open_pidfd ( services [ i ] . pid [ islog ] ) ;
+  if ( 0 > fd ) return ;
+
+  /* the pid, the pid index has the slot and follows it around */
+  memset ( & ev, 0, sizeof ( ev ) ) ;
+  ev . events = EPOLLIN ;
+  ev . data . u64 = (unsigned long long) services [ i ] . pid [ islog ] ;
+
+  if ( 0 > epoll_ctl ( epollfd, EPOLL_CTL_ADD, fd, & ev ) ) fd_close ( fd ) ;
+  else services [ i ] . pidfd [ islog ] = fd ;
+}
+
+/* reap the supervise processes whose pidfd says they exited */
+static void handle_pidfds ( void )
+{
+  struct epoll_event ev [ 64 ] ;
+  tain_t nextscan ;
+
+  tain_addsec_g ( & nextscan, 1 ) ;
+
+  for ( ; ; ) {
+    const int r = epoll_wait ( epollfd, ev, 64, 0 ) ;
+    int k = 0 ;
 
-        if (!services[i].pid[0] && (!services[i].flaglog || !services[i].pid[1]))
-          services [ i ] = services [ -- n ] ;
+    if ( r < 0 ) {
+      if ( EINTR == errno ) continue ;
+      panic ( "epoll_wait" ) ;
+    }
+
+    for ( ; k < r ; ++ k ) {
+      const pid_t pid = (pid_t) ev [ k ] . data . u64 ;
+      int wstat = 0 ;
+
+      /* else the sweep got it first and closed its pidfd */
+      if ( pid == waitpid ( pid, & wstat, WNOHANG ) ) {
+        const int who = pid_take ( pid ) ;
+
+        if ( 0 <= who ) exited ( who, & nextscan ) ;
       }
     }
+
+    /* only a full batch can leave more ready */
+    if ( r < 64 ) break ;
   }
 }
 
+#else
+
+static void pidfd_setup ( void )
+{
+}
+
+static void pidfd_add ( const unsigned int i, const int islog )
+{
+  (void) i ;
+  (void) islog ;
+}
+
+static void handle_pidfds ( void )
+{
+}
+
+#endif
 
 /* Second essential function: the scanner.
    It monitors the service directories and spawns a supervisor
    if needed. */
 
-static void trystart ( unsigned int i, char const * name, int islog )
+/*
+ * look s6-supervise up in PATH once, so starting it needs no search.
+ * if it is not found now posix_spawnp() still gets to try.
+ */
+static void find_supervise ( void )
 {
-  const pid_t pid = fork () ;
+  char const * p = getenv ( "PATH" ) ;
+  const size_t len = strlen ( supervise ) ;
 
-  switch ( pid ) {
-    case -1 :
-      tain_addsec_g(&services[i].restartafter[islog], CHECK_RETRY_TIMEOUT) ;
-      strerr_warnwu2sys("fork for ", name) ;
-      return ;
-    case 0 :
-    {
-      char const *cargv[3] = { "s6-supervise", name, 0 } ;
-      PROG = "s6-svscan (child)" ;
-      selfpipe_finish() ;
-      if (services[i].flaglog)
-        if (fd_move(!islog, services[i].p[!islog]) == -1)
-          strerr_diefu2sys(111, "set fds for ", name) ;
-      xpathexec_run(S6_BINPREFIX "s6-supervise", cargv, (char const **)environ) ;
+  if ( strchr ( supervise, '/' ) ) return ;
+  if ( NULL == p ) p = "/usr/bin:/bin" ;
+
+  while ( 1 ) {
+    char const * const end = strchr ( p, ':' ) ;
+    const size_t dlen = end ? (size_t) ( end - p ) : strlen ( p ) ;
+    char * const s = dlen ? malloc ( dlen + len + 2 ) : NULL ;
+
+    if ( s ) {
+      memcpy ( s, p, dlen ) ;
+      s [ dlen ] = '/' ;
+      memcpy ( s + dlen + 1, supervise, len + 1 ) ;
+      if ( 0 == access ( s, X_OK ) ) {
+        supervise = s ;
+        return ;
+      }
+      free ( s ) ;
     }
+
+    if ( NULL == end ) return ;
+    p = end + 1 ;
+  }
+}
+
+/*
+ * the child starts with an empty signal mask and the caught signals
+ * back to their defaults, what selfpipe_finish() did after fork().
+ */
+static int spawn_setup ( sigset_t const * caught )
+{
+  sigset_t none ;
+
+  sigemptyset ( & none ) ;
+
+  return posix_spawnattr_init ( & spawnattr )
+    || posix_spawnattr_setsigmask ( & spawnattr, & none )
+    || posix_spawnattr_setsigdefault ( & spawnattr, caught )
+    || posix_spawnattr_setflags ( & spawnattr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF ) ;
+}
+
+/*
+ * posix_spawn() instead of fork(): the C library does it with a
+ * vfork-like clone, the page tables of a large init are not copied.
+ */
+static void trystart ( unsigned int i, char const * name, int islog )
+{
+  char const * cargv [ 3 ] = { "s6-supervise", name, 0 } ;
+  posix_spawn_file_actions_t fa ;
+  pid_t pid = 0 ;
+  int e = posix_spawn_file_actions_init ( & fa ) ;
+
+  if ( ! e ) {
+    if ( services [ i ] . flaglog )
+      e = posix_spawn_file_actions_adddup2 ( & fa, services [ i ] . p [ ! islog ], ! islog ) ;
+
+    if ( ! e )
+      e = ( strchr ( supervise, '/' ) ? posix_spawn : posix_spawnp ) ( & pid, supervise,
+        & fa, & spawnattr, (char * const *) cargv, (char * const *) environ ) ;
+
+    (void) posix_spawn_file_actions_destroy ( & fa ) ;
+  }
+
+  if ( e ) {
+    errno = e ;
+    tain_addsec_g(&services[i].restartafter[islog], CHECK_RETRY_TIMEOUT) ;
+    timer_set ( i, islog ) ;
+    strerr_warnwu2sys("spawn supervisor for ", name) ;
+    return ;
   }
 
   services[i].pid[islog] = pid ;
+  pid_add ( pid, i, islog ) ;
+  pidfd_add ( i, islog ) ;
+  timer_del ( 2 * i + islog ) ;
 }
 
 static void retrydirlater ( void )
@@ -369,21 +925,42 @@ static void check ( char const * name )
 
   namelen = strlen(name) ;
 
-  for (; i < n ; i++) if ((services[i].ino == st.st_ino) && (services[i].dev == st.st_dev)) break ;
+  i = dir_find ( st . st_dev, st . st_ino ) ;
 
   if ( i < n ) {
+    /* renamed, or seen under another name first */
+    if ( ! services [ i ] . flagactive && strcmp ( services [ i ] . name, name ) ) {
+      char * const s = malloc ( namelen + 1 ) ;
+
+      if ( s ) {
+        memcpy ( s, name, namelen + 1 ) ;
+        name_del ( i ) ;
+        free ( services [ i ] . name ) ;
+        services [ i ] . name = s ;
+        name_add ( i ) ;
+      }
+    }
+
     if (services[i].flaglog && (services[i].p[0] < 0)) {
      /* See BLACK MAGIC above. */
       services[i].p[0] = -2 ;
       return ;
     }
   } else {
-    if (n >= max) {
-      strerr_warnwu3x("start supervisor for ", name, ": too many services") ;
+    if ( n >= max && ! resize_services ( 2 * max ) ) {
+      strerr_warnwu2sys ( "grow service table for ", name ) ;
+      retrydirlater () ;
       return ;
     } else {
       struct stat su ;
       char tmp[namelen + 5] ;
+      char * const s = malloc ( namelen + 1 ) ;
+      if ( ! s ) {
+        strerr_warnwu2sys ( "allocate slot for ", name ) ;
+        retrydirlater () ;
+        return ;
+      }
+      memcpy ( s, name, namelen + 1 ) ;
       memcpy(tmp, name, namelen) ;
       memcpy(tmp + namelen, "/log", 5) ;
       if (stat(tmp, &su) < 0)
@@ -391,6 +968,7 @@ static void check ( char const * name )
         else {
           strerr_warnwu2sys("stat ", tmp) ;
           retrydirlater() ;
+          free ( s ) ;
           return ;
         }
       else if (!S_ISDIR(su.st_mode))
@@ -399,17 +977,25 @@ static void check ( char const * name )
         if (pipecoe(services[i].p) < 0) {
           strerr_warnwu1sys("pipecoe") ;
           retrydirlater() ;
+          free ( s ) ;
           return ;
         }
         services[i].flaglog = 1 ;
       }
       services[i].ino = st.st_ino ;
       services[i].dev = st.st_dev ;
+      services[i].name = s ;
       tain_copynow(&services[i].restartafter[0]) ;
       tain_copynow(&services[i].restartafter[1]) ;
       services[i].pid[0] = 0 ;
       services[i].pid[1] = 0 ;
+      services[i].pidfd[0] = -1 ;
+      services[i].pidfd[1] = -1 ;
+      services[i].timer[0] = 0 ;
+      services[i].timer[1] = 0 ;
       ++ n ;
+      dir_add ( i ) ;
+      name_add ( i ) ;
     }
   }
   
@@ -421,18 +1007,36 @@ static void check ( char const * name )
       memcpy(tmp, name, namelen) ;
       memcpy(tmp + namelen, "/log", 5) ;
       trystart(i, tmp, 1) ;
-    } else if (tain_less(&services[i].restartafter[1], &deadline))
-      deadline = services[i].restartafter[1] ;
+    } else timer_set ( i, 1 ) ;
   }
 
   if ( ! services[i].pid[0]) {
     if (!tain_future(&services[i].restartafter[0]))
       trystart(i, name, 0) ;
-    else if (tain_less(&services[i].restartafter[0], &deadline))
-      deadline = services[i].restartafter[0] ;
+    else timer_set ( i, 0 ) ;
   }
 }
 
+/*
+ * drop slot i if its service is no longer in the scan directory and
+ * no supervise process of it is left.
+ */
+static void retire ( const unsigned int i )
+{
+  if ( services [ i ] . flagactive || services [ i ] . pid [ 0 ] ) return ;
+
+  if ( services [ i ] . flaglog ) {
+    if ( services [ i ] . pid [ 1 ] ) return ;
+
+    if ( services [ i ] . p [ 0 ] >= 0 ) {
+      fd_close ( services [ i ] . p [ 1 ] ) ; services [ i ] . p [ 1 ] = -1 ;
+      fd_close ( services [ i ] . p [ 0 ] ) ; services [ i ] . p [ 0 ] = -1 ;
+    }
+  }
+
+  drop_service ( i ) ;
+}
+
 static void scan ( void )
 {
   unsigned int i = 0 ;
@@ -469,21 +1073,189 @@ static void scan ( void )
 
   dir_close ( dir ) ;
 
-  for ( i = 0 ; i < n ; ++ i )
-    if ( ! services [ i ] . flagactive && ! services [ i ] . pid [ 0 ] ) {
-    if ( services [ i ] . flaglog ) {
-      if ( services [ i ] . pid [ 1 ] ) continue ;
+  /* backwards, so the slot moved into a dropped one was seen already */
+  for ( i = n ; i -- ; ) retire ( i ) ;
 
-      if ( services [ i ] . p [ 0 ] >= 0 ) {
-        fd_close ( services [ i ] . p [ 1 ] ) ; services [ i ] . p [ 1 ] = -1 ;
-        fd_close ( services [ i ] . p [ 0 ] ) ; services [ i ] . p [ 0 ] = -1 ;
-      }
+  /* the safety net for events the watch missed */
+  if ( 0 <= watchfd ) {
+    tain_t a ;
+    tain_addsec_g ( & a, FULL_SCAN_TIMEOUT ) ;
+    if ( tain_less ( & a, & deadline ) ) deadline = a ;
+  }
+}
+
+/* the service directory name was removed or renamed away */
+static void forget ( char const * name )
+{
+  struct stat st ;
+  unsigned int i ;
+
+  if ( '.' == name [ 0 ] ) return ;
+
+  /* there again already */
+  if ( 0 == stat ( name, & st ) ) {
+    check ( name ) ;
+    return ;
+  }
+
+  i = name_find ( name ) ;
+
+  /* another name of the same directory keeps it until the next full scan */
+  if ( i < n ) {
+    services [ i ] . flagactive = 0 ;
+    retire ( i ) ;
+  }
+}
+
+/* start the supervise processes whose restart is due */
+static void restart_due ( void )
+{
+  while ( ntimers && ! tain_future ( TIMER_AT ( timers [ 0 ] ) ) ) {
+    const unsigned int i = timers [ 0 ] >> 1 ;
+
+    timer_del ( timers [ 0 ] ) ;
+
+    /* check() makes sure it is still the service of that name */
+    if ( services [ i ] . flagactive ) check ( services [ i ] . name ) ;
+  }
+}
+
+/* queue a new directory to be checked once it is due, 0 if out of memory */
+static int newdir_add ( char const * name )
+{
+  const size_t len = strlen ( name ) ;
+  char * const s = malloc ( len + 1 ) ;
+  struct newdir_s * e ;
+
+  if ( NULL == s ) return 0 ;
+
+  if ( nnewdirs == newdirsmax ) {
+    const size_t cap = newdirsmax ? 2 * newdirsmax : MIN_SERVICES ;
+    struct newdir_s * const q = realloc ( newdirs, cap * sizeof ( * q ) ) ;
+
+    if ( NULL == q ) {
+      free ( s ) ;
+      return 0 ;
     }
 
-    services [ i ] = services [ -- n ] ;
+    /* the ones before the head wrapped around, put them after the rest */
+    memcpy ( q + newdirsmax, q, newdirshead * sizeof ( * q ) ) ;
+    newdirs = q ;
+    newdirsmax = cap ;
   }
+
+  memcpy ( s, name, len + 1 ) ;
+  e = newdirs + ( newdirshead + nnewdirs ) % newdirsmax ;
+  e -> name = s ;
+  tain_addsec_g ( & e -> due, NEW_DIR_TIMEOUT ) ;
+  ++ nnewdirs ;
+
+  return 1 ;
 }
 
+/* check the new directories that are due */
+static void newdir_due ( void )
+{
+  while ( nnewdirs && ! tain_future ( & newdirs [ newdirshead ] . due ) ) {
+    char * const name = newdirs [ newdirshead ] . name ;
+
+    newdirshead = ( newdirshead + 1 ) % newdirsmax ;
+    -- nnewdirs ;
+
+    /* else it went away meanwhile and forget() saw to it */
+    if ( 0 == access ( name, F_OK ) ) check ( name ) ;
+    free ( name ) ;
+  }
+}
+
+#if defined (OSLinux)
+
+#define WATCH_EVENTS	( IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+			| IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR )
+
+static void watch_setup ( void )
+{
+  watchfd = inotify_init1 ( IN_NONBLOCK | IN_CLOEXEC ) ;
+
+  if ( 0 <= watchfd && 0 > inotify_add_watch ( watchfd, ".", WATCH_EVENTS ) ) {
+    fd_close ( watchfd ) ;
+    watchfd = -1 ;
+  }
+
+  if ( 0 > watchfd ) strerr_warnwu1sys ( "watch scan directory, rescanning it in full" ) ;
+}
+
+/*
+ * entries moved or linked into the scan directory are checked and
+ * removed ones forgotten right away, without a full scan.  a new
+ * directory is queued and checked NEW_DIR_TIMEOUT from now.  if
+ * events were lost or the watch is gone a full scan is done instead.
+ */
+static void handle_watch ( void )
+{
+  while ( 0 <= watchfd ) {
+    char buf [ 4096 ] __attribute__ ((aligned (__alignof__ (struct inotify_event)))) ;
+    const ssize_t r = read ( watchfd, buf, sizeof ( buf ) ) ;
+    ssize_t j = 0 ;
+
+    if ( r < 0 && EINTR == errno ) continue ;
+    if ( r < 0 && EAGAIN == errno ) return ;
+
+    if ( r <= 0 ) {
+      strerr_warnwu1sys ( "read scan directory watch" ) ;
+      fd_close ( watchfd ) ;
+      watchfd = -1 ;
+      wantscan = 1 ;
+      return ;
+    }
+
+    while ( j < r ) {
+      const struct inotify_event * const ev = (const struct inotify_event *) ( buf + j ) ;
+
+      j += sizeof ( * ev ) + ev -> len ;
+
+      if ( ev -> mask & ( IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF ) ) {
+        fd_close ( watchfd ) ;
+        watchfd = -1 ;
+        wantscan = 1 ;
+        return ;
+      }
+
+      /* the full scan to come covers it */
+      if ( ev -> mask & IN_Q_OVERFLOW ) wantscan = 1 ;
+      else if ( wantscan || ! ev -> len ) continue ;
+      else if ( ev -> mask & IN_MOVED_TO ) check ( ev -> name ) ;
+      else if ( ev -> mask & IN_CREATE ) {
+        /*
+         * a directory made right there is likely still being filled
+         * (its log/ in particular), give it a moment and check it
+         * then, or scan then if it cannot be queued.  a new symlink
+         * points to a finished one.
+         */
+        if ( ! ( ev -> mask & IN_ISDIR ) ) check ( ev -> name ) ;
+        else if ( ! newdir_add ( ev -> name ) ) {
+          tain_t a ;
+          tain_addsec_g ( & a, NEW_DIR_TIMEOUT ) ;
+          if ( tain_less ( & a, & deadline ) ) deadline = a ;
+        }
+      }
+      else if ( ev -> mask & ( IN_DELETE | IN_MOVED_FROM ) ) forget ( ev -> name ) ;
+    }
+  }
+}
+
+#else
+
+static void watch_setup ( void )
+{
+}
+
+static void handle_watch ( void )
+{
+}
+
+#endif
+
 static void sig_setup ( void )
 {
 }
@@ -495,7 +1267,7 @@ int main ( int argc, char const * const * argv )
   unsigned long int f = 0 ;
   const pid_t mypid = getpid () ;
   const uid_t myuid = getuid () ;
-  iopause_fd x [ 2 ] = { { -1, IOPAUSE_READ, 0 }, { -1, IOPAUSE_READ, 0 } } ;
+  iopause_fd x [ 4 ] = { { -1, IOPAUSE_READ, 0 }, { -1, IOPAUSE_READ, 0 }, { -1, IOPAUSE_READ, 0 }, { -1, IOPAUSE_READ, 0 } } ;
 
   /* initialize global variables */
   PROG = "s6-svscan" ;
@@ -569,7 +1341,7 @@ int main ( int argc, char const * const * argv )
     if ( t ) tain_from_millisecs ( & defaulttimeout, t ) ;
     else defaulttimeout = tain_infinite_relative ;
 
-    if ( max < 2 ) max = 2 ;
+    if ( max < MIN_SERVICES ) max = MIN_SERVICES ;
   }
 
   /* Init phase.
@@ -584,6 +1356,9 @@ int main ( int argc, char const * const * argv )
 
   if ( x [ 0 ] . fd < 0 ) strerr_diefu1sys ( 111, "selfpipe_init" ) ;
 
+  watch_setup () ;
+  pidfd_setup () ;
+
   if ( sig_ignore ( SIGPIPE ) < 0 ) strerr_diefu1sys ( 111, "ignore SIGPIPE" ) ;
 
   {
@@ -603,17 +1378,20 @@ int main ( int argc, char const * const * argv )
     }
 
     if ( selfpipe_trapset ( & set ) < 0 ) strerr_diefu1sys ( 111, "trap signals" ) ;
+    if ( spawn_setup ( & set ) ) strerr_diefu1x ( 111, "set up spawn attributes" ) ;
   }
 
+  find_supervise () ;
+
   if ( notif ) {
     fd_write ( notif, "\n", 1 ) ;
     fd_close ( notif ) ;
     notif = 0 ;
   }
 
+  if ( ! resize_services ( max ) ) strerr_diefu1sys ( 111, "allocate service table" ) ;
+
   {
-    struct svinfo_s blob [ max ] ; /* careful with that stack, Eugene */
-    services = blob ;
     tain_now_g () ;
 
 
@@ -622,16 +1400,26 @@ int main ( int argc, char const * const * argv )
      * Temporize on recoverable errors, and panic on serious ones.
      */
     while ( cont ) {
+      tain_t wake ;
+      unsigned int nx = 2, j = 2 ;
       int r = 0 ;
 
       reap () ;
+      restart_due () ;
+      newdir_due () ;
       scan () ;
       killthem () ;
-      r = iopause_g ( x, 2, & deadline ) ;
+      if ( 0 <= watchfd ) x [ nx ++ ] . fd = watchfd ;
+      if ( 0 <= epollfd ) x [ nx ++ ] . fd = epollfd ;
+      wake = deadline ;
+      if ( ntimers && tain_less ( TIMER_AT ( timers [ 0 ] ), & wake ) ) wake = * TIMER_AT ( timers [ 0 ] ) ;
+      if ( nnewdirs && tain_less ( & newdirs [ newdirshead ] . due, & wake ) ) wake = newdirs [ newdirshead ] . due ;
+      r = iopause_g ( x, nx, & wake ) ;
 
       if ( r < 0 ) panic ( "iopause" ) ;
-      else if ( ! r ) wantscan = 1 ;
-      else {
+      else if ( ! r ) {
+        if ( ! tain_future ( & deadline ) ) wantscan = 1 ;
+      } else {
         if ( ( x [ 0 ] . revents | x [ 1 ] . revents ) & IOPAUSE_EXCEPT ) {
           errno = EIO ;
           panic("check internal pipes") ;
@@ -641,6 +1429,12 @@ int main ( int argc, char const * const * argv )
           divertsignals ? handle_diverted_signals () : handle_signals () ;
 
         if ( x [ 1 ] . revents & IOPAUSE_READ ) handle_control ( x [ 1 ] . fd ) ;
+
+        for ( ; j < nx ; ++ j ) {
+          if ( ! ( x [ j ] . revents & IOPAUSE_READ ) ) continue ;
+          if ( x [ j ] . fd == epollfd ) handle_pidfds () ;
+          else if ( x [ j ] . fd == watchfd ) handle_watch () ;
+        }
       }
     }
 